@@ -0,0 +1,79 @@
+#include <runtime.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+// asset_contention_bench [max threads]
+// times get_texture from a growing amount of threads at once, with and without a thread adding and removing textures
+namespace {
+
+double run(anvil::asset_manager &assets, const std::vector<anvil::texture_handle> &handles, int thread_count, bool writer) {
+    constexpr std::size_t lookups_per_thread = 1000000;
+
+    std::atomic<bool> go{ false };
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            std::uniform_int_distribution<std::size_t> pick(0, handles.size() - 1);
+            while (!go) {
+                std::this_thread::yield();
+            }
+            for (std::size_t i = 0; i < lookups_per_thread; i++) {
+                assets.get_texture(handles[pick(rng)]);
+            }
+        });
+    }
+    std::thread churn;
+    if (writer) {
+        churn = std::thread([&] {
+            while (!go) {
+                std::this_thread::yield();
+            }
+            while (!done) {
+                assets.remove_texture(assets.add_texture(std::make_shared<anvil::texture>()));
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    done = true;
+    if (churn.joinable()) {
+        churn.join();
+    }
+    return lookups_per_thread * thread_count / seconds;
+}
+
+}
+
+int main(int argc, char **argv) {
+    int max_threads = argc > 1 ? std::stoi(argv[1]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    anvil::asset_manager assets;
+    std::vector<anvil::texture_handle> handles;
+    for (int i = 0; i < 10000; i++) {
+        handles.push_back(assets.add_texture(std::make_shared<anvil::texture>()));
+    }
+
+    std::cout << "threads  lookups/s     lookups/s with writer\n";
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double readers_only = run(assets, handles, threads, false);
+        double with_writer = run(assets, handles, threads, true);
+        std::cout << threads << "\t " << static_cast<uint64_t>(readers_only) << "\t" << static_cast<uint64_t>(with_writer) << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <runtime.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+// asset_lookup_bench [assets] [lookups]
+// times asset_manager::get_texture over a table of empty textures, no gl context needed
+int main(int argc, char **argv) {
+    std::size_t asset_count = argc > 1 ? std::stoul(argv[1]) : 10000;
+    std::size_t lookup_count = argc > 2 ? std::stoul(argv[2]) : 10000000;
+
+    anvil::asset_manager assets;
+    std::vector<anvil::texture_handle> handles;
+    handles.reserve(asset_count);
+    for (std::size_t i = 0; i < asset_count; i++) {
+        handles.push_back(assets.add_texture(std::make_shared<anvil::texture>()));
+    }
+
+    // random order so the lookups don't just walk the table
+    std::vector<anvil::texture_handle> order(lookup_count);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<std::size_t> pick(0, asset_count - 1);
+    for (auto &h : order) {
+        h = handles[pick(rng)];
+    }
+
+    std::size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &h : order) {
+        found += assets.get_texture(h) != nullptr;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // stale handles take the same path up to the generation check
+    for (std::size_t i = 0; i < asset_count; i += 2) {
+        assets.remove_texture(handles[i]);
+    }
+    std::size_t stale_found = 0;
+    auto stale_start = std::chrono::steady_clock::now();
+    for (const auto &h : order) {
+        stale_found += assets.get_texture(h) != nullptr;
+    }
+    double stale_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - stale_start).count();
+
+    std::cout << "assets:        " << asset_count << '\n';
+    std::cout << "lookups:       " << lookup_count << " (" << found << " found)\n";
+    std::cout << "get_texture:   " << seconds * 1e9 / lookup_count << " ns/lookup\n";
+    std::cout << "half removed:  " << stale_seconds * 1e9 / lookup_count << " ns/lookup (" << stale_found << " found)\n";
+    return found == lookup_count ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+#include <runtime.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// audio_batch_bench <directory> [runs]
+// times decoding every .ogg in a directory one by one with audio(path) against asset_manager::load_audio_batch
+// needs an openal device
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cout << "usage: audio_batch_bench <directory of .ogg files> [runs]\n";
+        return 1;
+    }
+    int runs = argc > 2 ? std::stoi(argv[2]) : 3;
+
+    std::vector<std::string> paths;
+    for (auto &e : std::filesystem::directory_iterator(argv[1])) {
+        if (e.path().extension() == ".ogg") {
+            paths.push_back(e.path().string());
+        }
+    }
+    if (paths.empty()) {
+        std::cout << "no .ogg files in " << argv[1] << "\n";
+        return 1;
+    }
+    std::sort(paths.begin(), paths.end());
+
+    anvil::asset_manager assets;
+    assets.init_audio_context();
+
+    double serial = 1e30;
+    double batch = 1e30;
+    for (int run = 0; run < runs; run++) {
+        // the old path, every file decoded on this thread in its constructor
+        {
+            std::vector<std::unique_ptr<anvil::audio>> loaded;
+            auto start = std::chrono::steady_clock::now();
+            for (const auto &p : paths) {
+                loaded.push_back(std::make_unique<anvil::audio>(p));
+            }
+            serial = std::min(serial, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<anvil::audio_handle> handles = assets.load_audio_batch(paths);
+        batch = std::min(batch, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        std::size_t failed = std::count_if(handles.begin(), handles.end(), [](const anvil::audio_handle &h) { return !h.valid(); });
+        if (failed) {
+            std::cout << failed << " files failed to load in the batch\n";
+        }
+        for (const auto &h : handles) {
+            assets.remove_audio(h);
+        }
+    }
+
+    std::cout << paths.size() << " files, best of " << runs << " runs\n";
+    std::cout << "serial: " << serial * 1000 << " ms\n";
+    std::cout << "batch:  " << batch * 1000 << " ms (" << serial / batch << "x)\n";
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <runtime.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+
+// input_dispatch_bench [events] [listeners]
+// feeds synthetic events to the glfw callbacks game::create installs and times the dispatch to the listeners
+// needs a display for the window
+int main(int argc, char **argv) {
+    std::size_t event_count = argc > 1 ? std::stoul(argv[1]) : 10000000;
+    int listener_count = argc > 2 ? std::stoi(argv[2]) : 4;
+
+    anvil::game game("input_dispatch_bench", { 64, 64 });
+    game.create(false, false, 0);
+    GLFWwindow *window = glfwGetCurrentContext();
+
+    // the setters hand back the installed callbacks, put them straight back
+    GLFWkeyfun key_callback = glfwSetKeyCallback(window, nullptr);
+    glfwSetKeyCallback(window, key_callback);
+    GLFWmousebuttonfun mouse_callback = glfwSetMouseButtonCallback(window, nullptr);
+    glfwSetMouseButtonCallback(window, mouse_callback);
+    GLFWcursorposfun move_callback = glfwSetCursorPosCallback(window, nullptr);
+    glfwSetCursorPosCallback(window, move_callback);
+
+    // listeners that read the modifiers so the mask queries are part of the measurement
+    uint64_t seen = 0;
+    for (int i = 0; i < listener_count; i++) {
+        anvil::io::add_listener(anvil::io::key_listener_t([&seen](const anvil::io::key_event &e) {
+            seen += e.modifiers.has(anvil::io::modifier::shift) + e.modifiers.has(anvil::io::modifier::control);
+        }));
+        anvil::io::add_listener(anvil::io::mouse_listener_t([&seen](const anvil::io::mouse_event &e) {
+            seen += e.modifiers.any();
+        }));
+        anvil::io::add_listener(anvil::io::mouse_move_listener_t([&seen](const anvil::io::mouse_move_event &e) {
+            seen += e.position.x > 0.0;
+        }));
+    }
+
+    auto time = [&](const char *name, const std::function<void(std::size_t)> &send) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < event_count; i++) {
+            send(i);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << name << ": " << event_count / seconds / 1e6 << " M events/s, " << seconds * 1e9 / event_count << " ns/event\n";
+    };
+
+    std::cout << event_count << " events per type, " << listener_count << " listeners per type\n";
+    time("key", [&](std::size_t i) {
+        int action = i & 1 ? GLFW_RELEASE : GLFW_PRESS;
+        key_callback(window, GLFW_KEY_A + static_cast<int>(i % 26), 0, action, static_cast<int>(i % 4) * GLFW_MOD_SHIFT);
+    });
+    time("mouse", [&](std::size_t i) {
+        int action = i & 1 ? GLFW_RELEASE : GLFW_PRESS;
+        mouse_callback(window, static_cast<int>(i % 3), action, i % 8 == 0 ? GLFW_MOD_CONTROL : 0);
+    });
+    time("mouse move", [&](std::size_t i) {
+        move_callback(window, static_cast<double>(i % 1920), static_cast<double>(i % 1080));
+    });
+    std::cout << "(" << seen << " listener hits)\n";
+    return 0;
+}
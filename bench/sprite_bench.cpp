@@ -0,0 +1,51 @@
+#include <runtime.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// sprite_bench [size] [channels]
+// times the sprite flips, crop and resize on a size x size image, no gl context needed
+int main(int argc, char **argv) {
+    int size = argc > 1 ? std::stoi(argv[1]) : 4096;
+    int channels = argc > 2 ? std::stoi(argv[2]) : 4;
+
+    std::vector<uint8_t> pixels(static_cast<std::size_t>(size) * size * channels);
+    uint32_t state = 1;
+    for (auto &p : pixels) {
+        state = state * 1664525u + 1013904223u;
+        p = static_cast<uint8_t>(state >> 24);
+    }
+    anvil::sprite source({ size, size }, channels, pixels);
+    double megapixels = static_cast<double>(size) * size / 1e6;
+
+    // each run works on a fresh copy, the copy isn't timed
+    auto time = [&](const std::string &name, const std::function<void(anvil::sprite &)> &fn) {
+        const int runs = 5;
+        double best = 1e30;
+        for (int i = 0; i < runs; i++) {
+            anvil::sprite s = source;
+            auto start = std::chrono::steady_clock::now();
+            fn(s);
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::cout << name << ": " << best * 1000 << " ms, " << megapixels / best << " Mpx/s of source\n";
+    };
+
+    std::cout << size << "x" << size << "x" << channels << "\n";
+    time("fliph", [](anvil::sprite &s) { s.fliph(); });
+    time("flipv", [](anvil::sprite &s) { s.flipv(); });
+    time("crop to a centered half", [size](anvil::sprite &s) { s.crop({ size / 4, size / 4 }, { size / 2, size / 2 }); });
+
+    const anvil::resize_filter filters[] = { anvil::resize_filter::nearest, anvil::resize_filter::bilinear, anvil::resize_filter::bicubic, anvil::resize_filter::lanczos };
+    const char *names[] = { "nearest", "bilinear", "bicubic", "lanczos" };
+    for (int f = 0; f < 4; f++) {
+        time(std::string("resize ") + names[f] + " to half", [&](anvil::sprite &s) { s.resize({ size / 2, size / 2 }, filters[f]); });
+        time(std::string("resize ") + names[f] + " to 1.25x", [&](anvil::sprite &s) { s.resize({ size * 5 / 4, size * 5 / 4 }, filters[f]); });
+    }
+    return 0;
+}
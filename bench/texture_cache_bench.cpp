@@ -0,0 +1,76 @@
+#include <runtime.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// texture_cache_bench <directory of images>
+// times loading every .png and .jpg in a directory straight from the source, through a cold cache and through a warm one
+// needs a display, the uploads go through a hidden window's gl context
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cout << "usage: texture_cache_bench <directory of .png/.jpg files>\n";
+        return 1;
+    }
+
+    std::vector<std::string> sources;
+    for (auto &e : std::filesystem::directory_iterator(argv[1])) {
+        std::string extension = e.path().extension().string();
+        if (extension == ".png" || extension == ".jpg" || extension == ".jpeg") {
+            sources.push_back(e.path().string());
+        }
+    }
+    if (sources.empty()) {
+        std::cout << "no images in " << argv[1] << "\n";
+        return 1;
+    }
+    std::sort(sources.begin(), sources.end());
+
+    if (!glfwInit()) {
+        std::cout << "no gl context\n";
+        return 1;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "texture_cache_bench", nullptr, nullptr);
+    if (!window) {
+        std::cout << "no gl context\n";
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "anvil_texture_cache_bench";
+    std::filesystem::remove_all(directory);
+    anvil::texture_cache cache(directory.string());
+
+    auto time = [&](const char *name, const std::function<bool(const std::string &)> &load) {
+        std::size_t loaded = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const auto &s : sources) {
+            loaded += load(s);
+        }
+        glFinish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << name << ": " << seconds * 1000 << " ms, " << seconds * 1e6 / sources.size() << " us/texture (" << loaded << " loaded)\n";
+    };
+
+    std::cout << sources.size() << " sprites\n";
+    time("source", [](const std::string &s) {
+        return anvil::sprite(s).convert_to_texture() != nullptr;
+    });
+    time("cold cache", [&](const std::string &s) {
+        return cache.load(s) != nullptr;
+    });
+    time("warm cache", [&](const std::string &s) {
+        return cache.load(s) != nullptr;
+    });
+    std::cout << "hits " << cache.get_hits() << ", misses " << cache.get_misses() << "\n";
+
+    std::filesystem::remove_all(directory);
+    glfwTerminate();
+    return 0;
+}
@@ -4,12 +4,20 @@
 #include <GLFW/glfw3.h>
 #include <AL/al.h>
 #include <AL/alc.h>
+#include <atomic>
+#include <bitset>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <functional>
+#include <future>
+#include <list>
 #include <map>
 #include <mutex>
 #include <memory>
+#include <queue>
+#include <shared_mutex>
 #include <string>
 #include <sys/types.h>
 #include <thread>
@@ -146,10 +154,77 @@ public:
 class shader;
 class font;
 class texture;
+class audio;
+class asset_manager;
+struct text_layout;
+
+/// @brief a typed generational handle to an asset owned by an asset_manager
+/// @note a default constructed handle is invalid
+/// @note handles stay valid while an asset is lazily unloaded, removing the asset invalidates them
+/// @note slots of removed assets are reused, the generation tells old and new assets apart
+template<typename T>
+struct asset_handle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+
+    /// @brief returns false for default constructed handles
+    bool valid() const { return generation != 0; }
+
+    bool operator==(const asset_handle &other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const asset_handle &other) const { return !(*this == other); }
+};
+
+/// @brief bytes held by an asset
+struct memory_usage {
+    std::size_t cpu_bytes = 0;
+    std::size_t gpu_bytes = 0;
+
+    std::size_t total() const { return cpu_bytes + gpu_bytes; }
+};
+
+enum class asset_type {
+    texture,
+    font,
+    audio,
+    shader
+};
+
+using texture_handle    =       asset_handle<texture>;
+using font_handle       =       asset_handle<font>;
+using audio_handle      =       asset_handle<audio>;
+using shader_handle     =       asset_handle<shader>;
 
 // for renderer_2d
 struct __compiledshaderobj;
 
+// for asset_manager
+struct __threadpool;
+
+// for texture_uploader
+struct __stagingbuffer;
+struct __pendingupload;
+
+/// @brief a frame read back by renderer_2d::start_capture(...)
+struct captured_frame {
+    /// @brief value of the frame counter when the frame was rendered
+    uint64_t frame;
+
+    /// @brief glfwGetTime() at the end of the frame
+    double time;
+
+    anvil::vec2i_t size;
+
+    /// @brief tightly packed RGBA rows, top row first
+    std::vector<uint8_t> pixels;
+};
+
+/// @brief called on the capture thread for every captured frame
+/// @note the frame may be moved from, e.g. into a sprite for save_to_file(...)
+using capture_callback_t = std::function<void(anvil::captured_frame &)>;
+
+// for renderer_2d
+struct __framecapture;
+
 class renderer_2d {
 private:
     bool is_vsync = false;
@@ -162,13 +237,20 @@ private:
     double frame_start_time;
     double delta_time;
 
-    uint64_t frame_counter;
+    uint64_t frame_counter = 0;
 
     int triangle_count;
 
     std::vector<__compiledshaderobj> compiled_shaders;
+
+    std::shared_ptr<anvil::texture> placeholder_texture;
+
+    std::unique_ptr<__framecapture> capture;
 private:
     void glinit();
+
+    /// @brief queue readback of the back buffer and hand finished readbacks to the capture thread
+    void capture_frame();
 public:
     /// @brief starts drawing a new frame
     void begin_frame();
@@ -182,7 +264,12 @@ public:
 
     /// @brief draws some text with specified font
     /// @param rotation spans 0-180
-    void draw_text(std::string text, anvil::font font, anvil::vec2f_t pos, anvil::rgba_color color, float rotation);
+    void draw_text(std::string text, const anvil::font &font, anvil::vec2f_t pos, anvil::rgba_color color, float rotation);
+
+    /// @brief draws a text layout with specified font
+    /// @note the font must be the one the layout was created with
+    /// @param pos the top left corner of the layout
+    void draw_text(const anvil::text_layout &layout, const anvil::font &font, anvil::vec2f_t pos, anvil::rgba_color color);
 
     // @brief draws a circle with the triangle fan drawing method
     // @note this is extremely inefficient at high segment count
@@ -208,13 +295,40 @@ public:
     void fps(int);
 
     /// @brief runs a shader
+    /// @note compiled programs are cached by the shader's handle, or by its source if it was never added to an asset_manager
     void run_shader(anvil::shader shader);
 
     /// @brief draws a pixel with specified color and position
     void draw_pixel(anvil::vec2f_t position, anvil::rgba_color);
 
     /// @brief draws a texture
-    void draw_texture(anvil::texture texture, anvil::vec2f_t pos, anvil::vec2i_t size);
+    /// @note textures still being streamed in are drawn as the placeholder, or not at all if there is none
+    void draw_texture(const anvil::texture &texture, anvil::vec2f_t pos, anvil::vec2i_t size);
+
+    /// @brief starts capturing every frame at the end of end_frame()
+    /// @note frames are read back into a ring of pixel buffer objects and arrive a frame or two later
+    /// @note frames are dropped instead of stalling the render thread if the gpu or callback falls behind
+    /// @param callback called on a separate thread for each frame, in order
+    /// @param ring_size amount of frames in flight on the gpu
+    void start_capture(anvil::capture_callback_t callback, int ring_size = 3);
+
+    /// @brief stops capturing
+    /// @note frames still in flight are delivered before returning
+    void stop_capture();
+
+    /// @brief returns if frames are being captured
+    bool is_capturing();
+
+    /// @brief get amount of frames dropped since start_capture(...)
+    uint64_t get_dropped_frames();
+
+    /// @brief sets the texture drawn in place of textures that are not ready yet
+    /// @note pass nullptr to skip drawing them instead
+    void placeholder(std::shared_ptr<anvil::texture> texture);
+
+    /// @brief draws a texture owned by an asset manager
+    /// @note draws nothing if the handle is no longer valid
+    void draw_texture(anvil::asset_manager &assets, anvil::texture_handle texture, anvil::vec2f_t pos, anvil::vec2i_t size);
 
     /// @brief get amount of frames that has passed
     uint64_t get_frame_counter();
@@ -266,7 +380,7 @@ enum class shader_type {
 /// @note does not get lazy loaded
 class shader {
 private:
-    int id;
+    anvil::shader_handle handle;
     anvil::shader_type type;
     friend class asset_manager;
     friend class renderer_2d;
@@ -277,10 +391,112 @@ public:
     /// @param glsl_code the code of the shader (glsl)
     /// @note glsl code must conform to OpenGL 3.3 (or 4.3 if ANVIL_RUNTIME_OPENGL_SUPPORT_COMPUTE_SHADER is defined) standards
     shader(std::string glsl_code, anvil::shader_type type);
+
+    /// @brief get the memory used by the shader
+    /// @note compiled programs are owned by the renderer and not counted
+    anvil::memory_usage get_memory_usage() const;
 };
 
 class texture;
 
+enum class archive_compression : uint32_t {
+    none = 0,
+    lz4 = 1
+};
+
+/// @brief a read-only packed asset archive
+/// @note the archive is memory mapped, uncompressed entries are read straight out of the mapping
+/// @note layout: header, table of contents sorted by name hash, names, then blobs aligned to 16 bytes
+/// @note all integers are little endian
+class archive {
+private:
+    struct header {
+        char magic[8];
+        uint32_t version;
+        uint32_t entry_count;
+        uint64_t names_offset;
+        uint64_t names_size;
+    };
+
+    struct entry {
+        uint64_t name_hash;
+        uint64_t offset;
+        uint64_t stored_size;
+        uint64_t size;
+        uint32_t name_offset;
+        uint32_t name_length;
+        anvil::archive_compression compression;
+        uint32_t reserved;
+    };
+
+    const uint8_t *mapping = nullptr;
+    std::size_t mapping_size = 0;
+
+    const entry *entries = nullptr;
+    uint32_t entry_count = 0;
+    const char *names = nullptr;
+private:
+    /// @brief returns nullptr if there is no entry with that name
+    const entry *find(const std::string &name) const;
+public:
+    /// @brief returns if the archive has an entry with that name
+    bool contains(const std::string &name) const;
+
+    /// @brief get the uncompressed size of an entry
+    /// @note returns 0 if the entry doesn't exist
+    std::size_t size_of(const std::string &name) const;
+
+    /// @brief get the bytes of an uncompressed entry without copying
+    /// @note returns nullptr if the entry doesn't exist or is compressed, use read(...) for those
+    /// @note the pointer is valid for as long as the archive is
+    const uint8_t *view(const std::string &name, std::size_t &size) const;
+
+    /// @brief read an entry, decompressing it if needed
+    /// @note returns false if the entry doesn't exist or is corrupt
+    bool read(const std::string &name, std::vector<uint8_t> &out) const;
+
+    /// @brief get the names of all entries
+    std::vector<std::string> list() const;
+
+    /// @brief write an archive
+    /// @param files pairs of entry name and path of the file on disk
+    /// @param compress lz4-compress entries that get smaller by doing so
+    /// @note returns false if a file could not be read or the output could not be written
+    static bool pack(const std::vector<std::pair<std::string, std::string>> &files, const std::string &output, bool compress);
+public:
+    /// @brief constructor for archive, maps the file
+    archive(std::string path);
+
+    archive(const archive &) = delete;
+    archive &operator=(const archive &) = delete;
+
+    /// @brief destructor, unmaps the file
+    ~archive();
+};
+
+/// @brief how the mip chain of a texture is generated
+enum class mipmap_mode {
+    /// @brief single level, linear filtering
+    none,
+    /// @brief generated by the driver with glGenerateMipmap
+    gpu,
+    /// @brief generated on the cpu with a 2x2 box filter
+    /// @note deterministic across drivers, costs cpu time on upload
+    box,
+};
+
+/// @brief filter used by sprite::resize(...)
+enum class resize_filter {
+    /// @brief closest source pixel, fastest, blocky when upscaling
+    nearest,
+    /// @brief linear interpolation between the 2 closest pixels on each axis
+    bilinear,
+    /// @brief cubic interpolation over 4 pixels on each axis
+    bicubic,
+    /// @brief lanczos over 6 pixels on each axis, sharpest but slowest
+    lanczos,
+};
+
 /// @brief a custom sprite
 /// @note not a valid asset, convert to texture first
 class sprite {
@@ -289,14 +505,37 @@ private:
     int channels;
 
     std::vector<uint8_t> data;
+
+    /// @brief file the sprite was loaded from, cleared once the pixels are modified
+    std::string path;
+
+    friend class asset_manager;
+    friend class texture_uploader;
+private:
+    /// @brief decode an image file into the sprite
+    /// @note returns false instead of exiting if the file can't be decoded, safe to call off the render thread
+    bool load(const std::string &filename);
+
+    /// @brief decode an encoded image in memory into the sprite
+    bool load(const uint8_t *bytes, std::size_t length);
+
+    sprite() = default;
 public:
     /// @brief save sprite to a file
-    /// @note saves in png format
-    /// @note not implemented
-    void save_to_file(std::string file) const;
+    /// @note saves in qoi format if the file ends in .qoi, png otherwise
+    /// @note the sprite must be in RGBA or RGB format
+    /// @param compression_level png deflate level from 0 (stored, fastest) to 9 (smallest), ignored for qoi
+    /// @return false if the file could not be written
+    bool save_to_file(std::string file, int compression_level = 6) const;
+
+    /// @brief save sprite to a file on a background thread
+    /// @note encodes a copy, the sprite can be modified or destroyed right away
+    std::future<bool> save_to_file_async(std::string file, int compression_level = 6) const;
 
     /// @brief resize the sprite
-    void resize(anvil::vec2i_t new_size);
+    /// @param filter resampling filter, filters other than nearest also smooth when downscaling
+    /// @note large sprites are resized on multiple threads
+    void resize(anvil::vec2i_t new_size, anvil::resize_filter filter = anvil::resize_filter::nearest);
 
     /// @brief crop the sprite
     void crop(anvil::vec2i_t pos, anvil::vec2i_t size);
@@ -310,45 +549,325 @@ public:
     /// @brief convert the sprite to a texture
     /// @note does not free the data
     /// @note the sprite must be in RGBA format
-    /// @note does not set the id of the texture, use asset_manager::add_texture(...)
-    std::shared_ptr<anvil::texture> convert_to_texture();
+    /// @note does not register the texture, use asset_manager::add_texture(...)
+    /// @note textures of unmodified sprites can be reloaded by the asset manager after being evicted
+    /// @param mips how to generate the mip chain, none uploads a single level
+    std::shared_ptr<anvil::texture> convert_to_texture(anvil::mipmap_mode mips = anvil::mipmap_mode::none);
 public:
     /// @brief constructor for a sprite
     sprite(std::string filename);
+
+    /// @brief constructor for a sprite stored in an archive
+    sprite(const anvil::archive &archive, std::string name);
+
+    /// @brief constructor for a sprite from raw pixels
+    /// @param pixels tightly packed rows, size.x * size.y * channels bytes
+    sprite(anvil::vec2i_t size, int channels, std::vector<uint8_t> pixels);
 public:
+    /// @brief get the size of the sprite in pixels
+    anvil::vec2i_t get_size() const;
+
+    /// @brief get the number of bytes per pixel
+    int get_channels() const;
+
+    /// @brief get the pixels, tightly packed rows of size.x * channels bytes
+    const std::vector<uint8_t> &get_data() const;
 };
 
 /// @brief a custom font
 class font {
 private:
     std::string path;
-    int id;
+    anvil::font_handle handle;
+    int size;
     friend class asset_manager;
 private:
     uint8_t *ttf_buffer = new uint8_t[1 << 20];
     uint8_t *temp_bitmap = new uint8_t[512 * 512];
     stbtt_bakedchar *cdata = new stbtt_bakedchar[96];
 
+    stbtt_fontinfo info;
+    GLuint tid = 0;
+    float scale;
+
+    /// @brief unique per font object for the whole run, keys layout caches since freed fonts' addresses get reused
+    uint64_t serial = next_serial();
+    float ascent;
+    float descent;
+    float line_gap;
+
     friend class renderer_2d;
+    friend class text_layout_engine;
+private:
+    /// @brief read and bake the font
+    /// @note returns false instead of exiting on failure, does no gl calls so it is safe to call off the render thread
+    bool load(const std::string &filepath, int font_size);
+
+    /// @brief bake the font from the bytes already in ttf_buffer
+    bool bake(int font_size);
+
+    /// @brief upload the baked glyph atlas
+    /// @note must be called on the thread owning the gl context
+    void upload();
+
+    static uint64_t next_serial();
+
+    font() = default;
 public:
+    /// @brief get the horizontal advance of a codepoint
+    /// @note includes kerning against next, pass 0 as next to skip kerning
+    /// @note codepoints outside of the baked range (32-126) have an advance of 0
+    float get_advance(int codepoint, int next) const;
+
+    /// @brief get the kerning between two codepoints in pixels
+    float get_kerning(int codepoint, int next) const;
+
+    /// @brief get the distance between two baselines in pixels
+    float get_line_height() const;
+
+    /// @brief get the distance from the baseline to the top of the tallest glyph in pixels
+    float get_ascent() const;
+
+    /// @brief get the pixel size the font was baked with
+    int get_size() const;
+
+    /// @brief measure a single line of text
+    /// @note newlines are not handled, use text_layout_engine for multi-line text
+    float measure(const std::string &text) const;
+
+    /// @brief get the memory used by the font
+    anvil::memory_usage get_memory_usage() const;
 public:
     /// @brief constructor for font
     /// @param filepath the path to the .ttf file
     /// @param font_size the size of the font
     font(std::string filepath, int font_size);
+
+    /// @brief constructor for a font stored in an archive
+    /// @note fonts from archives can't be reloaded by the asset manager, so they are never evicted by the memory budget
+    font(const anvil::archive &archive, std::string name, int font_size);
+
+    font(const font &) = delete;
+    font &operator=(const font &) = delete;
+public:
+    /// @brief frees the font data and deletes the glyph atlas
+    /// @note must run on the thread owning the gl context, asset managers hand the fonts they drop to that thread
+    ~font();
+};
+
+enum class text_align {
+    left,
+    center,
+    right
+};
+
+/// @brief a single positioned glyph of a text_layout
+struct text_glyph {
+    int codepoint;
+    /// @brief pen position of the glyph on the baseline, relative to the layout origin
+    anvil::vec2f_t position;
+};
+
+/// @brief a single line of a text_layout
+struct text_line {
+    /// @brief index of the first glyph of the line in text_layout::glyphs
+    std::size_t first_glyph;
+    /// @brief amount of glyphs in the line
+    std::size_t glyph_count;
+    float width;
+};
+
+/// @brief the result of laying out text with text_layout_engine
+struct text_layout {
+    std::vector<anvil::text_glyph> glyphs;
+    std::vector<anvil::text_line> lines;
+
+    /// @brief width of the widest line and height of all lines
+    anvil::vec2f_t size;
+    float line_height;
+};
+
+/// @brief measures, wraps and aligns text for a font
+/// @note results are cached by (font, text, max width, alignment) so laying out the same text again is a lookup
+/// @note the cache is not thread safe, use one engine per thread
+class text_layout_engine {
+private:
+    struct cache_key {
+        uint64_t font;
+        std::string text;
+        float max_width;
+        anvil::text_align align;
+
+        bool operator==(const cache_key &other) const;
+    };
+
+    struct cache_key_hash {
+        std::size_t operator()(const cache_key &key) const;
+    };
+
+    using cache_entry = std::pair<cache_key, std::shared_ptr<const anvil::text_layout>>;
+
+    std::size_t capacity;
+
+    // front is the most recently used
+    std::list<cache_entry> entries;
+    std::unordered_map<cache_key, std::list<cache_entry>::iterator, cache_key_hash> lookup;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+private:
+    std::shared_ptr<const anvil::text_layout> build(const anvil::font &font, const std::string &text, float max_width, anvil::text_align align);
+public:
+    /// @brief measure text without wrapping
+    /// @note handles newlines, returns the size of the bounding box of all lines
+    anvil::vec2f_t measure(const anvil::font &font, const std::string &text);
+
+    /// @brief lay out text, wrapping words at max_width
+    /// @param max_width maximum width of a line, 0 or less disables wrapping
+    /// @note words wider than max_width are broken between characters
+    std::shared_ptr<const anvil::text_layout> layout(const anvil::font &font, const std::string &text, float max_width, anvil::text_align align);
+
+    /// @brief drop all cached layouts
+    void clear();
+
+    /// @brief get amount of cache hits
+    uint64_t get_hits() const;
+
+    /// @brief get amount of cache misses
+    uint64_t get_misses() const;
+public:
+    /// @brief constructor for text_layout_engine
+    /// @param capacity maximum amount of cached layouts
+    text_layout_engine(std::size_t capacity = 256);
 };
 
 /// @brief a custom texture uploaded to the gpu
 class texture {
 private:
-    int id;
+    anvil::texture_handle handle;
     anvil::vec2i_t size;
 
-    GLuint tid;
+    GLuint tid = 0;
+
+    /// @brief file the pixels came from, empty if they can't be reloaded
+    std::string source;
+
+    /// @brief false while the pixels are still being streamed in by a texture_uploader
+    bool ready = true;
+
+    /// @brief true if source is a dds or ktx file instead of an image
+    bool compressed = false;
+    anvil::mipmap_mode mips = anvil::mipmap_mode::none;
+
+    /// @brief bytes of all levels on the gpu
+    std::size_t gpu_bytes = 0;
 
     friend class asset_manager;
     friend class renderer_2d;
     friend class sprite;
+    friend class texture_cache;
+    friend class texture_uploader;
+private:
+    /// @brief create the gl texture from tightly packed rgb or rgba pixels of size
+    void upload(const uint8_t *pixels, int channels, anvil::mipmap_mode mips = anvil::mipmap_mode::none);
+
+    /// @brief create the gl texture from a dds or ktx file in memory
+    /// @note supports BC1, BC3 and BC7
+    bool upload_compressed(const uint8_t *bytes, std::size_t length, const std::string &name);
+public:
+    /// @brief returns if the pixels of the texture are resident on the gpu
+    /// @note always true unless the texture came from texture_uploader
+    bool is_ready() const;
+
+    /// @brief get the memory used by the texture
+    anvil::memory_usage get_memory_usage() const;
+public:
+    /// @brief empty texture, filled by sprite::convert_to_texture() and friends
+    texture() = default;
+
+    /// @brief load a gpu compressed texture
+    /// @param path path to a .dds or .ktx file holding BC1, BC3 or BC7 blocks
+    /// @note all mip levels stored in the file are uploaded
+    texture(const std::string &path);
+
+    /// @brief load a gpu compressed texture from an archive
+    texture(const anvil::archive &archive, const std::string &name);
+
+    texture(const texture &) = delete;
+    texture &operator=(const texture &) = delete;
+public:
+    /// @brief deletes the gl texture
+    /// @note must run on the thread owning the gl context, asset managers hand the textures they drop to that thread
+    ~texture();
+};
+
+/// @brief streams texture uploads through a pool of pixel buffer objects
+/// @note upload(...) returns right away, the copy to the gpu happens asynchronously and is tracked with fences
+/// @note all functions must be called on the thread owning the gl context
+class texture_uploader {
+private:
+    std::vector<__stagingbuffer> buffers;
+    std::vector<__pendingupload> queue;
+public:
+    /// @brief queue a sprite for upload
+    /// @note the returned texture reports is_ready() once its pixels are resident
+    /// @note the sprite must be in RGBA or RGB format
+    std::shared_ptr<anvil::texture> upload(anvil::sprite sprite);
+
+    /// @brief start queued uploads on free buffers and mark finished textures ready
+    /// @note call once per frame
+    void update();
+
+    /// @brief get amount of uploads that are queued or in flight
+    std::size_t pending() const;
+public:
+    /// @brief constructor for texture_uploader
+    /// @param buffer_count amount of pixel buffer objects, bounds the uploads in flight
+    /// @param buffer_size size of each pixel buffer object, larger sprites are uploaded synchronously
+    texture_uploader(std::size_t buffer_count = 4, std::size_t buffer_size = 16 << 20);
+public:
+    /// @brief deletes the pixel buffer objects
+    /// @note waits for uploads in flight, queued uploads are dropped
+    void cleanup();
+
+    /// @brief destructor, calls cleanup()
+    ~texture_uploader();
+};
+
+/// @brief an on-disk cache of decoded texture pixels
+/// @note entries are rgba, keyed by the source path and invalidated when its modification time or size changes
+/// @note entries are memory mapped and uploaded straight from the mapping, skipping the png/jpg decode
+class texture_cache {
+private:
+    std::string directory;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+private:
+    /// @brief path of the cache entry for a source file
+    std::string entry_path(const std::string &source) const;
+public:
+    /// @brief load a texture through the cache
+    /// @note decodes the source and writes a cache entry if there is no valid one
+    /// @note must be called on the thread owning the gl context
+    /// @note returns nullptr if the source can't be loaded
+    std::shared_ptr<anvil::texture> load(const std::string &source);
+
+    /// @brief returns if there is a valid cache entry for a source file
+    bool contains(const std::string &source) const;
+
+    /// @brief remove every entry from the cache directory
+    void clear();
+
+    /// @brief get amount of loads served from the cache
+    uint64_t get_hits() const;
+
+    /// @brief get amount of loads that had to decode the source
+    uint64_t get_misses() const;
+public:
+    /// @brief constructor for texture_cache
+    /// @param directory where entries are stored, created if it doesn't exist
+    texture_cache(std::string directory);
 };
 
 /// @brief context for audio
@@ -362,92 +881,915 @@ public:
     /// @brief constructor for audio_context
     /// @note there is no point constructing this as this is used internally
     audio_context();
+
+    audio_context(const audio_context &) = delete;
+    audio_context &operator=(const audio_context &) = delete;
+
+    /// @brief deletes the sources of the voice pool, then destroys the openal context and closes the device
+    /// @note runs once the asset manager and every audio using the context are gone
+    ~audio_context();
+};
+
+/// @brief a sound started by audio::play(...)
+/// @note the handle goes stale once the sound finishes or its voice is stolen, functions taking it then do nothing
+struct voice_handle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+
+    /// @brief returns false for default constructed handles and sounds that could not be started
+    bool valid() const { return generation != 0; }
+
+    bool operator==(const voice_handle &other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const voice_handle &other) const { return !(*this == other); }
 };
 
 /// @brief a custom audio
 class audio {
 private:
     std::string path;
-    int id;
+    anvil::audio_handle handle;
     std::shared_ptr<audio_context> context;
-    ALuint *buffer;
+    ALuint *buffer = nullptr;
+    std::size_t buffer_bytes = 0;
+    double duration = 0.0;
     friend class asset_manager;
+    friend class audio_scene;
 private:
     void set_audio_context(std::shared_ptr<audio_context>);
+
+    /// @brief create the openal buffer from interleaved 16 bit samples
+    void upload(const int16_t *samples, std::size_t frames, int channels, int sample_rate);
+
+    audio() = default;
 public:
     /// @brief plays the audio asynchronously
-    void play();
+    /// @note voices come from a fixed pool of openal sources, see set_voice_limit(...)
+    /// @note when the pool is exhausted the lowest priority, oldest voice is stolen if its priority is not higher
+    /// @param priority higher priority sounds are kept longer
+    /// @return invalid handle if every voice is busy with a higher priority sound
+    anvil::voice_handle play(int priority = 0);
+
+    /// @brief stops a playing sound
+    static void stop(anvil::voice_handle voice);
+
+    /// @brief returns if the sound is still playing
+    static bool is_playing(anvil::voice_handle voice);
+
+    /// @brief set volume of a playing sound, 1 is unchanged
+    static void set_gain(anvil::voice_handle voice, float gain);
+
+    /// @brief set pitch of a playing sound, 1 is unchanged
+    static void set_pitch(anvil::voice_handle voice, float pitch);
+
+    /// @brief set maximum amount of sources in the voice pool
+    /// @note defaults to 32, lowered automatically if openal can't create more sources
+    /// @note never drops below the amount of sources already created
+    static void set_voice_limit(std::size_t limit);
+
+    /// @brief get the memory used by the audio
+    /// @note the openal buffer is counted as cpu memory
+    anvil::memory_usage get_memory_usage() const;
+
+    /// @brief get the length of the audio in seconds
+    double get_duration() const;
 public:
     /// @brief constructor for audio
     /// @param path the path to the .ogg file
     /// @note only takes in .ogg files
     audio(std::string path);
+
+    /// @brief constructor for an audio stored in an archive
+    /// @note audio from archives can't be reloaded by the asset manager, so it is never evicted by the memory budget
+    audio(const anvil::archive &archive, std::string name);
 public:
     void cleanup();
     ~audio();
 };
 
+/// @brief a sound placed in an audio_scene
+struct emitter_handle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+
+    /// @brief returns false for default constructed handles
+    bool valid() const { return generation != 0; }
+
+    bool operator==(const emitter_handle &other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const emitter_handle &other) const { return !(*this == other); }
+};
+
+/// @brief how an emitter is played and attenuated
+struct emitter_settings {
+    float gain = 1.0f;
+    bool looping = false;
+
+    /// @brief higher priority emitters keep their voice over louder lower priority ones
+    int priority = 0;
+
+    /// @brief distance at which the gain starts to drop
+    float reference_distance = 1.0f;
+
+    /// @brief the emitter is inaudible past this distance
+    float max_distance = 100.0f;
+
+    /// @brief how fast the gain drops with distance
+    float rolloff = 1.0f;
+};
+
+// for audio_scene
+struct __emitter {
+    std::shared_ptr<anvil::audio> sound;
+    std::function<anvil::vec3f_t()> position;
+    anvil::emitter_settings settings;
+
+    /// @brief seconds played, keeps advancing while the emitter is virtual
+    double elapsed = 0.0;
+
+    /// @brief gain after distance attenuation, from the last update()
+    float audible_gain = 0.0f;
+
+    /// @brief result of position from the last update()
+    anvil::vec3f_t last_position = { 0.0f, 0.0f, 0.0f };
+
+    /// @brief index into the scene sources, -1 while virtual
+    int source = -1;
+
+    uint32_t generation = 1;
+    bool active = false;
+};
+
+/// @brief positional audio with a listener and emitters
+/// @note only the loudest emitters get one of a fixed amount of openal sources, the rest are virtual
+/// @note virtual emitters keep their playback position and resume where they would be once they become audible again
+/// @note sounds must be mono to be spatialized, stereo sounds play unattenuated by openal
+/// @note all functions must be called from the thread owning the audio context
+class audio_scene {
+private:
+    std::vector<__emitter> emitters;
+    std::vector<uint32_t> free_emitters;
+
+    std::vector<ALuint> sources;
+    // emitter index per source, -1 if the source is free
+    std::vector<int64_t> source_owner;
+
+    float gain_threshold;
+    anvil::vec3f_t listener = { 0.0f, 0.0f, 0.0f };
+
+    std::chrono::steady_clock::time_point last_update;
+    bool started = false;
+
+    // scratch for update(), kept so updates don't allocate once they reached their size
+    std::vector<uint32_t> audible;
+    std::vector<bool> heard;
+private:
+    void make_real(uint32_t index, std::size_t source, anvil::vec3f_t position);
+    void make_virtual(uint32_t index);
+    void release(uint32_t index);
+    __emitter *find(anvil::emitter_handle handle);
+public:
+    /// @brief set the listener position and orientation
+    void set_listener(anvil::vec3f_t position, anvil::vec3f_t forward = { 0.0f, 0.0f, -1.0f }, anvil::vec3f_t up = { 0.0f, 1.0f, 0.0f });
+
+    /// @brief set the listener position for 2d scenes, emitters positions have z 0
+    void set_listener(anvil::vec2f_t position);
+
+    /// @brief add a playing emitter
+    /// @param position called every update() for the current position, see anvil::ecs::follow(...)
+    anvil::emitter_handle add_emitter(std::shared_ptr<anvil::audio> sound, std::function<anvil::vec3f_t()> position, anvil::emitter_settings settings = {});
+
+    /// @brief stop and remove an emitter
+    void remove_emitter(anvil::emitter_handle emitter);
+
+    /// @brief set the gain of an emitter before attenuation
+    void set_gain(anvil::emitter_handle emitter, float gain);
+
+    /// @brief returns if the emitter is still playing, false once a non looping emitter has finished
+    bool is_playing(anvil::emitter_handle emitter);
+
+    /// @brief returns if the emitter is playing without an openal source
+    bool is_virtual(anvil::emitter_handle emitter);
+
+    /// @brief move emitters, pick which ones are heard and drop finished ones
+    /// @note call once per frame
+    void update();
+
+    /// @brief get amount of emitters holding an openal source
+    std::size_t get_real_count() const;
+
+    /// @brief get amount of playing emitters without an openal source
+    std::size_t get_virtual_count() const;
+public:
+    /// @brief constructor for audio_scene
+    /// @param voice_budget amount of openal sources, the most emitters heard at once
+    /// @param gain_threshold emitters quieter than this after attenuation are virtualized
+    audio_scene(std::size_t voice_budget = 32, float gain_threshold = 0.01f);
+
+    audio_scene(const audio_scene &) = delete;
+    audio_scene &operator=(const audio_scene &) = delete;
+public:
+    /// @brief stops all emitters and deletes the openal sources
+    void cleanup();
+    ~audio_scene();
+};
+
+/// @brief decoded interleaved 16 bit samples kept in memory, played by audio_mixer
+struct pcm_buffer {
+    int channels = 0;
+    int sample_rate = 0;
+    std::vector<int16_t> samples;
+
+    /// @brief get amount of sample frames
+    std::size_t frames() const { return channels ? samples.size() / channels : 0; }
+
+    /// @brief get the memory used by the samples
+    anvil::memory_usage get_memory_usage() const;
+
+    pcm_buffer() = default;
+
+    /// @brief decode an .ogg file
+    pcm_buffer(std::string path);
+
+    /// @brief decode an .ogg file stored in an archive
+    pcm_buffer(const anvil::archive &archive, std::string name);
+};
+
+/// @brief how pcm_cache stores decoded samples
+enum class pcm_format {
+    /// @brief 16 bit, lossless, shared with callers without copying
+    pcm16,
+    /// @brief 8 bit, half the size, audible noise on quiet sounds
+    pcm8,
+    /// @brief 4 bit ima adpcm, a quarter of the size, fine for most effects
+    adpcm,
+};
+
+// for pcm_cache
+struct __pcmentry {
+    anvil::pcm_format format;
+    int channels;
+    int sample_rate;
+    std::size_t frames;
+
+    /// @brief compact samples, nullptr for pcm16
+    /// @note shared so a get(...) can expand them after unlocking even if the entry is evicted meanwhile
+    std::shared_ptr<const std::vector<uint8_t>> data;
+
+    /// @brief the decoded samples for pcm16
+    std::shared_ptr<const anvil::pcm_buffer> pcm;
+
+    /// @brief 16 bit samples for data, handed out again while anyone still holds them
+    std::weak_ptr<const anvil::pcm_buffer> expanded;
+
+    std::list<std::string>::iterator lru;
+
+    std::size_t bytes() const;
+};
+
+/// @brief a cache of decoded audio samples keyed by path
+/// @note lets audio evicted by an asset_manager and audio shared between instances skip the vorbis decode
+/// @note least recently used entries are dropped once the budget is exceeded
+/// @note thread safe
+class pcm_cache {
+private:
+    anvil::pcm_format format;
+    std::size_t budget;
+    std::size_t bytes = 0;
+
+    // most recently used first
+    std::list<std::string> lru;
+    std::unordered_map<std::string, __pcmentry> entries;
+    mutable std::mutex mutex;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+private:
+    /// @brief drop entries until the cache fits its budget
+    void evict();
+public:
+    /// @brief get the decoded samples of an .ogg file, decoding and caching it on a miss
+    /// @note returns nullptr if the file could not be decoded
+    std::shared_ptr<const anvil::pcm_buffer> get(const std::string &path);
+
+    /// @brief returns if the file is cached
+    bool contains(const std::string &path) const;
+
+    /// @brief drop every entry
+    void clear();
+
+    /// @brief set the budget in bytes of stored samples
+    void set_budget(std::size_t budget);
+
+    /// @brief get the memory used by the stored samples
+    anvil::memory_usage get_memory_usage() const;
+
+    uint64_t get_hits() const;
+    uint64_t get_misses() const;
+public:
+    /// @brief constructor for pcm_cache
+    /// @param budget maximum bytes of stored samples
+    /// @param format how samples are stored, compact formats are expanded to 16 bit by get(...) unless an earlier expansion is still in use
+    pcm_cache(std::size_t budget = 64 << 20, anvil::pcm_format format = anvil::pcm_format::pcm16);
+};
+
+/// @brief cost of the most recent audio_mixer blocks
+struct mixer_stats {
+    /// @brief time to mix the last block
+    std::chrono::microseconds last_block;
+
+    /// @brief slowest block since the mixer started
+    std::chrono::microseconds max_block;
+
+    /// @brief playback length of one block, mixing must stay well below it
+    std::chrono::microseconds block_duration;
+
+    uint64_t blocks;
+    uint32_t active_voices;
+
+    /// @brief play() and control calls dropped because the command queue was full
+    uint64_t dropped_commands;
+
+    /// @brief play_at(...) voices that started after their time because they were scheduled too late
+    uint64_t late_starts;
+
+    /// @brief frames mixed and queued to openal but not played yet
+    uint64_t queued_frames;
+
+    /// @brief time until a sound mixed now is heard, from queued_frames
+    std::chrono::microseconds output_latency;
+};
+
+// for audio_mixer
+struct __mixerstate;
+
+/// @brief mixes many voices in software into a single streaming openal source
+/// @note use for large amounts of short effects, each audio::play(...) costs a whole openal source
+/// @note mixing runs on its own audio thread, calls from game threads are passed to it through a lock-free queue
+/// @note needs a current openal context, see asset_manager::init_audio_context()
+class audio_mixer {
+private:
+    std::unique_ptr<__mixerstate> state;
+private:
+    anvil::voice_handle schedule(std::shared_ptr<const anvil::pcm_buffer> pcm, uint64_t start_frame, float gain, float pan, float pitch, bool looping);
+public:
+    /// @brief start playing samples
+    /// @note the samples are shared with the voice until it finishes
+    /// @param pan -1 is fully left, 1 is fully right
+    /// @param pitch playback speed, 1 is unchanged
+    /// @return invalid handle if all voices are busy
+    anvil::voice_handle play(std::shared_ptr<const anvil::pcm_buffer> pcm, float gain = 1.0f, float pan = 0.0f, float pitch = 1.0f, bool looping = false);
+
+    /// @brief start playing samples exactly at a time of the audio clock
+    /// @note starts with sample accuracy if scheduled at least output_latency ahead, otherwise as soon as possible
+    /// @param time seconds on the audio clock, see get_time()
+    anvil::voice_handle play_at(double time, std::shared_ptr<const anvil::pcm_buffer> pcm, float gain = 1.0f, float pan = 0.0f, float pitch = 1.0f, bool looping = false);
+
+    /// @brief get the audio clock, seconds of output that have been played
+    /// @note derived from the samples openal reports as played, not from the system clock
+    double get_time() const;
+
+    /// @brief get the output sample rate
+    int get_sample_rate() const;
+
+    /// @brief stops a voice
+    void stop(anvil::voice_handle voice);
+
+    /// @brief stops all voices
+    void stop_all();
+
+    /// @brief set volume of a voice, 1 is unchanged
+    void set_gain(anvil::voice_handle voice, float gain);
+
+    /// @brief set pan of a voice, -1 is fully left, 1 is fully right
+    void set_pan(anvil::voice_handle voice, float pan);
+
+    /// @brief set pitch of a voice, 1 is unchanged
+    void set_pitch(anvil::voice_handle voice, float pitch);
+
+    /// @brief get mixing cost statistics
+    anvil::mixer_stats get_stats() const;
+public:
+    /// @brief constructor for audio_mixer, starts the audio thread
+    /// @param sample_rate output sample rate, voices are resampled to it
+    /// @param block_frames frames mixed at once, smaller blocks lower latency but cost more wakeups
+    /// @param max_voices maximum amount of voices playing at once
+    audio_mixer(int sample_rate = 48000, int block_frames = 512, std::size_t max_voices = 256);
+
+    audio_mixer(const audio_mixer &) = delete;
+    audio_mixer &operator=(const audio_mixer &) = delete;
+public:
+    /// @brief stops the audio thread and deletes the openal source
+    void cleanup();
+    ~audio_mixer();
+};
+
+// for audio_stream
+struct __audiostream;
+
+/// @brief a long audio track decoded incrementally while it plays
+/// @note only a few small buffers are held in memory, use this for music instead of audio
+/// @note buffers are refilled on a background audio thread shared by all streams
+/// @note needs a current openal context, see asset_manager::init_audio_context()
+class audio_stream {
+private:
+    std::shared_ptr<__audiostream> state;
+public:
+    /// @brief starts or resumes playback
+    /// @note restarts from the beginning if the stream was stopped or has finished
+    void play();
+
+    /// @brief pauses playback, play() resumes where it left off
+    void pause();
+
+    /// @brief stops playback and rewinds
+    void stop();
+
+    /// @brief returns if the stream is playing
+    /// @note false once a non looping stream has finished
+    bool is_playing() const;
+
+    /// @brief set if the stream starts over when it reaches the end
+    void set_looping(bool looping);
+
+    /// @brief get the memory used by the stream
+    anvil::memory_usage get_memory_usage() const;
+public:
+    /// @brief constructor for audio_stream
+    /// @param path the path to the .ogg file
+    /// @note only takes in .ogg files
+    audio_stream(std::string path);
+
+    /// @brief constructor for an audio stream stored in an archive
+    /// @note keeps a copy of the compressed entry in memory
+    audio_stream(const anvil::archive &archive, std::string name);
+
+    audio_stream(const audio_stream &) = delete;
+    audio_stream &operator=(const audio_stream &) = delete;
+public:
+    void cleanup();
+    ~audio_stream();
+};
+
+// for asset_manager
+struct __evictcandidate {
+    anvil::asset_type type;
+    uint32_t index;
+    uint32_t generation;
+    std::chrono::high_resolution_clock::rep last_access;
+    std::size_t bytes;
+};
+
+// for asset_manager
+struct __expiryentry {
+    std::chrono::high_resolution_clock::time_point deadline;
+    anvil::asset_type type;
+    uint32_t index;
+    uint32_t generation;
+
+    bool operator>(const __expiryentry &other) const { return deadline > other.deadline; }
+};
+
+// for asset_manager
+struct __deferredwork {
+    std::function<void()> run;
+    /// @brief called instead of run when cleanup() drops the work, may be empty
+    std::function<void()> cancel;
+};
+
+// for asset_manager
+template<typename T>
+struct __assetslot {
+    using clock = std::chrono::high_resolution_clock;
+
+    /// @brief nullptr if the asset has been unloaded
+    std::shared_ptr<T> asset;
+
+    /// @brief ticks of clock, written by readers holding only a shared lock
+    std::atomic<clock::rep> last_access{0};
+
+    /// @brief recreates the asset after it has been unloaded, empty if it cannot be reloaded
+    std::function<std::shared_ptr<T>(anvil::asset_handle<T>)> reload;
+
+    /// @brief usage of asset when it was installed, so unloading subtracts what was added
+    anvil::memory_usage usage;
+
+    uint32_t generation = 1;
+    bool occupied = false;
+
+    /// @brief the slot has a pending entry in the expiry scheduler
+    bool scheduled = false;
+
+    /// @brief a reload was handed to another thread, set and cleared without an exclusive lock
+    std::atomic<bool> reload_pending{false};
+
+    /// @brief refresh the access time
+    /// @note skips the store if it was refreshed less than a millisecond ago so readers of a hot asset don't fight over the cache line
+    void touch() {
+        clock::rep now = clock::now().time_since_epoch().count();
+        clock::rep last = last_access.load(std::memory_order_relaxed);
+        if (now - last > std::chrono::duration_cast<clock::duration>(std::chrono::milliseconds(1)).count()) {
+            last_access.store(now, std::memory_order_relaxed);
+        }
+    }
+
+    clock::time_point get_last_access() const {
+        return clock::time_point(clock::duration(last_access.load(std::memory_order_relaxed)));
+    }
+};
+
+// for asset_manager
+// readers take a shared lock, only insert, remove, reload and unload take it exclusively
+template<typename T>
+struct __assettable {
+    // deque so growing never moves slots (and their atomics)
+    std::deque<__assetslot<T>> slots;
+    std::vector<uint32_t> free_slots;
+
+    mutable std::shared_mutex mutex;
+
+    // totals of all loaded assets, changed under an exclusive lock and read without one
+    std::atomic<std::size_t> cpu_bytes{0};
+    std::atomic<std::size_t> gpu_bytes{0};
+
+    // bumped for every asset loaded into a slot, the only way usage grows
+    std::atomic<uint64_t> installs{0};
+
+    /// @brief called with index, generation and access time whenever a loaded asset needs an expiry deadline
+    /// @note called with mutex held exclusively, must not call back into the table
+    std::function<void(uint32_t, uint32_t, typename __assetslot<T>::clock::time_point)> on_install;
+
+    /// @brief takes the asset whenever one is unloaded or removed, e.g. to drop it on another thread
+    /// @note called with mutex held exclusively, must not call back into the table
+    std::function<void(std::shared_ptr<T>)> on_release;
+
+    /// @brief set the asset of a slot and count its memory
+    /// @note caller must hold mutex exclusively
+    void install(uint32_t index, std::shared_ptr<T> asset) {
+        __assetslot<T> &slot = slots[index];
+        slot.asset = std::move(asset);
+        slot.usage = slot.asset ? slot.asset->get_memory_usage() : anvil::memory_usage{};
+        cpu_bytes += slot.usage.cpu_bytes;
+        gpu_bytes += slot.usage.gpu_bytes;
+        if (slot.asset) {
+            installs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (slot.asset && on_install && !slot.scheduled) {
+            slot.scheduled = true;
+            on_install(index, slot.generation, slot.get_last_access());
+        }
+    }
+
+    /// @brief drop the asset of a slot and stop counting its memory
+    /// @note caller must hold mutex exclusively
+    void uninstall(__assetslot<T> &slot) {
+        cpu_bytes -= slot.usage.cpu_bytes;
+        gpu_bytes -= slot.usage.gpu_bytes;
+        slot.usage = {};
+        if (slot.asset && on_release) {
+            on_release(std::move(slot.asset));
+        }
+        slot.asset.reset();
+    }
+
+    anvil::memory_usage get_memory_usage() const {
+        return { cpu_bytes.load(std::memory_order_relaxed), gpu_bytes.load(std::memory_order_relaxed) };
+    }
+
+    /// @brief returns nullptr if the handle is stale or out of range
+    /// @note caller must hold mutex
+    __assetslot<T> *find(anvil::asset_handle<T> handle) {
+        if (handle.index >= slots.size()) {
+            return nullptr;
+        }
+        __assetslot<T> &slot = slots[handle.index];
+        if (!slot.occupied || slot.generation != handle.generation) {
+            return nullptr;
+        }
+        return &slot;
+    }
+
+    /// @brief mark an unloaded asset as being reloaded by another thread, see restore(...)
+    /// @note returns false if the handle is stale, the asset is loaded or the reload was already claimed
+    bool claim_reload(anvil::asset_handle<T> handle) {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        __assetslot<T> *slot = find(handle);
+        return slot && !slot->asset && !slot->reload_pending.exchange(true);
+    }
+
+    /// @brief install a reloaded asset unless the slot was removed or reloaded in the meantime
+    /// @note clears a claim made with claim_reload(...), asset is nullptr if the reload failed
+    /// @return the asset now in the slot
+    std::shared_ptr<T> restore(anvil::asset_handle<T> handle, std::shared_ptr<T> asset) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        __assetslot<T> *slot = find(handle);
+        if (!slot) {
+            return nullptr;
+        }
+        slot->reload_pending = false;
+        // another thread may have reloaded it in the meantime, keep theirs
+        if (!slot->asset && asset) {
+            install(handle.index, std::move(asset));
+        }
+        return slot->asset;
+    }
+
+    /// @brief returns the asset and refreshes its access time
+    /// @note reloads the asset outside of the lock if it was unloaded
+    /// @note returns nullptr if the reload failed or was handed to another thread
+    std::shared_ptr<T> acquire(anvil::asset_handle<T> handle) {
+        std::function<std::shared_ptr<T>(anvil::asset_handle<T>)> reload;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            __assetslot<T> *slot = find(handle);
+            if (!slot) {
+                return nullptr;
+            }
+            slot->touch();
+            if (slot->asset || !slot->reload) {
+                return slot->asset;
+            }
+            reload = slot->reload;
+        }
+
+        std::shared_ptr<T> asset = reload(handle);
+        if (!asset) {
+            return nullptr;
+        }
+        return restore(handle, std::move(asset));
+    }
+
+    anvil::asset_handle<T> insert(std::shared_ptr<T> asset, std::function<std::shared_ptr<T>(anvil::asset_handle<T>)> reload) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        uint32_t index;
+        if (!free_slots.empty()) {
+            index = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            index = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        }
+        __assetslot<T> &slot = slots[index];
+        slot.reload = std::move(reload);
+        slot.last_access.store(__assetslot<T>::clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        slot.occupied = true;
+        install(index, std::move(asset));
+        return { index, slot.generation };
+    }
+
+    bool remove(anvil::asset_handle<T> handle) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        __assetslot<T> *slot = find(handle);
+        if (!slot) {
+            return false;
+        }
+        uninstall(*slot);
+        slot->reload = nullptr;
+        slot->occupied = false;
+        // pending expiry entries and reloads see the new generation and drop themselves
+        slot->scheduled = false;
+        slot->reload_pending = false;
+        // 0 is reserved for invalid handles
+        if (++slot->generation == 0) {
+            slot->generation = 1;
+        }
+        free_slots.push_back(handle.index);
+        return true;
+    }
+
+    /// @brief unload an asset whose expiry deadline passed unless it was accessed since before
+    /// @note returns true and sets last_access if the asset is still in use and needs a new deadline
+    bool expire(uint32_t index, uint32_t generation, typename __assetslot<T>::clock::time_point before, typename __assetslot<T>::clock::time_point &last_access) {
+        {
+            // the common case is an asset that was used since, which only needs a shared lock
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            __assetslot<T> *slot = find({ index, generation });
+            if (!slot) {
+                return false;
+            }
+            if (slot->asset && slot->get_last_access() >= before) {
+                last_access = slot->get_last_access();
+                return true;
+            }
+        }
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        __assetslot<T> *slot = find({ index, generation });
+        if (!slot) {
+            return false;
+        }
+        if (slot->asset && slot->get_last_access() >= before) {
+            last_access = slot->get_last_access();
+            return true;
+        }
+        if (slot->asset) {
+            uninstall(*slot);
+        }
+        slot->scheduled = false;
+        return false;
+    }
+
+    /// @brief append every asset that could be evicted to candidates
+    /// @note only reloadable assets nobody outside the manager holds on to are candidates
+    void collect_evictable(anvil::asset_type type, std::vector<__evictcandidate> &candidates) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        for (uint32_t i = 0; i < slots.size(); i++) {
+            const __assetslot<T> &slot = slots[i];
+            if (slot.asset && slot.reload && slot.asset.use_count() == 1) {
+                candidates.push_back({ type, i, slot.generation, slot.last_access.load(std::memory_order_relaxed), slot.usage.total() });
+            }
+        }
+    }
+
+    /// @brief unload an asset if it is still loaded and unused
+    /// @note returns the amount of bytes freed
+    std::size_t evict(uint32_t index, uint32_t generation) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        __assetslot<T> *slot = find({ index, generation });
+        if (!slot || !slot->asset || slot->asset.use_count() != 1) {
+            return 0;
+        }
+        std::size_t freed = slot->usage.total();
+        uninstall(*slot);
+        return freed;
+    }
+};
+
 /// @brief a lazy-loading asset manager
 /// @note lazy loading timeout is customizable and can be turned off in the constructor
+/// @note a memory budget can be set in either mode, least recently used assets are evicted once it is exceeded
+/// @note all functions are thread safe, get_* from many threads at once do not block each other
 class asset_manager {
 private:
     std::chrono::seconds timeout;
-    bool lazy_loading;
-
-    std::vector<std::shared_ptr<shader>> shaders;
-    
-    std::unordered_map<std::shared_ptr<font>,    std::chrono::time_point<std::chrono::high_resolution_clock>> fonts;
-    std::unordered_map<std::shared_ptr<texture>, std::chrono::time_point<std::chrono::high_resolution_clock>> textures;
-    std::unordered_map<std::shared_ptr<audio>,   std::chrono::time_point<std::chrono::high_resolution_clock>> audios;
+    std::atomic<bool> lazy_loading;
 
-    //                    path      id
-    std::unordered_map<std::string, int> audios_removed;
-    //                    path                id & fsize
-    std::unordered_map<std::string, std::tuple<int, int>> fonts_removed;
+    // 0 is unlimited
+    std::atomic<std::size_t> memory_budget{0};
+    std::mutex budget_mutex;
+    // sum of the tables' installs at the last eviction pass, a pass with no loads since would find the same candidates
+    std::atomic<uint64_t> budget_installs{UINT64_MAX};
 
-    int shader_id = 0;
-
-    int font_id = 0;
-    int texture_id = 0;
-    int audio_id = 0;
+    __assettable<shader>  shaders;
+    __assettable<font>    fonts;
+    __assettable<texture> textures;
+    __assettable<audio>   audios;
 
     std::shared_ptr<audio_context> audio_context;
 
+    // min-heap of expiry deadlines, the cleanup thread sleeps until the earliest one
+    std::priority_queue<__expiryentry, std::vector<__expiryentry>, std::greater<__expiryentry>> expiries;
+    std::mutex expiry_mutex;
+    std::condition_variable expiry_cv;
+
     std::thread cleanup_thread;
-    std::mutex asset_mutex;
+
+    // decoding for load_*_async, started on first use and stopped for good by cleanup()
+    // shared so a submit racing cleanup() never touches a freed pool
+    std::shared_ptr<__threadpool> workers;
+    std::mutex workers_mutex;
+    bool workers_stopped = false;
+
+    // gpu and openal work left by load_*_async for process_uploads
+    std::deque<__deferredwork> uploads;
+    std::mutex upload_mutex;
+    bool uploads_stopped = false;
+
+    // accessed with std::atomic_load and std::atomic_store
+    std::shared_ptr<anvil::pcm_cache> audio_cache;
+private:
+    /// @brief returns the worker pool, starting it if needed
+    /// @note returns nullptr after cleanup()
+    std::shared_ptr<__threadpool> get_workers();
+
+    /// @brief decode an .ogg file, through the pcm cache if one is set
+    std::shared_ptr<const anvil::pcm_buffer> decode_audio(const std::string &path);
+
+    /// @brief queue work for the next process_uploads
+    /// @note cancel runs instead if cleanup() was called, or once it is
+    void queue_upload(std::function<void()> upload, std::function<void()> cancel = nullptr);
+
+    /// @brief make textures and fonts dropped off the gl thread get destroyed in process_uploads
+    void route_releases();
+
+    /// @brief queue an expiry deadline for a loaded asset
+    void schedule_expiry(anvil::asset_type type, uint32_t index, uint32_t generation, std::chrono::high_resolution_clock::time_point last_access);
+
+    /// @brief body of the cleanup thread
+    void run_expiries();
+
+    /// @brief reload an evicted or expired texture
+    /// @note on the gl thread this loads right away, anywhere else it only decodes and process_uploads(...) restores it later
+    /// @note returns nullptr if the source can't be loaded or the upload was deferred
+    std::shared_ptr<texture> reload_texture(anvil::texture_handle handle, const std::string &source, bool compressed, anvil::mipmap_mode mips);
+
+    /// @brief reload an evicted or expired font
+    /// @note same threading as reload_texture(...)
+    std::shared_ptr<font> reload_font(anvil::font_handle handle, const std::string &path, int size);
+
+    /// @brief evict least recently used assets until usage is within the budget
+    /// @note cheap when under budget or when nothing was loaded since the last pass, skipped if another thread is already enforcing
+    void enforce_memory_budget();
 public:
-    /// @brief get an audio by its id
-    /// @note returns nullptr if doesn't exist
-    std::shared_ptr<audio> get_audio(int id);
+    /// @brief get an audio by its handle
+    /// @note reloads the audio if it was unloaded
+    /// @note returns nullptr if doesn't exist or can't be reloaded
+    std::shared_ptr<audio> get_audio(anvil::audio_handle handle);
 
     /// @brief add an audio
-    /// @note allocates memory for it and returns the id of the audio
-    int add_audio(std::shared_ptr<audio>);
+    /// @note allocates memory for it and returns the handle of the audio
+    anvil::audio_handle add_audio(std::shared_ptr<audio>);
 
-    /// @brief get a texture by its id
-    /// @note returns nullptr if doesn't exist
-    std::shared_ptr<texture> get_texture(int id);
+    /// @brief remove an audio
+    /// @note invalidates all handles to it, returns false if the handle was already invalid
+    bool remove_audio(anvil::audio_handle handle);
+
+    /// @brief get a texture by its handle
+    /// @note reloads the texture if it was unloaded, off the gl thread it is decoded there and uploaded by process_uploads(...)
+    /// @note returns nullptr if doesn't exist, can't be reloaded or its upload is still queued
+    std::shared_ptr<texture> get_texture(anvil::texture_handle handle);
 
     /// @brief add a texture
-    /// @note allocates memory for it and returns the id of the texture
-    int add_texture(std::shared_ptr<texture>);
+    /// @note allocates memory for it and returns the handle of the texture
+    anvil::texture_handle add_texture(std::shared_ptr<texture>);
 
-    /// @brief get a font by its id
-    /// @note returns nullptr if doesn't exist
-    std::shared_ptr<font> get_font(int id);
+    /// @brief remove a texture
+    /// @note invalidates all handles to it, returns false if the handle was already invalid
+    bool remove_texture(anvil::texture_handle handle);
+
+    /// @brief get a font by its handle
+    /// @note reloads the font if it was unloaded, off the gl thread it is read there and uploaded by process_uploads(...)
+    /// @note returns nullptr if doesn't exist, can't be reloaded or its upload is still queued
+    std::shared_ptr<font> get_font(anvil::font_handle handle);
 
     /// @brief add a font
-    /// @note allocates memory for it and returns the id of the font
-    int add_font(std::shared_ptr<font>);
+    /// @note allocates memory for it and returns the handle of the font
+    anvil::font_handle add_font(std::shared_ptr<font>);
+
+    /// @brief remove a font
+    /// @note invalidates all handles to it, returns false if the handle was already invalid
+    bool remove_font(anvil::font_handle handle);
 
-    /// @brief get a shader by its id
-    /// @note shader_id is the id of the shader and not the id of glsl shader it contains
+    /// @brief get a shader by its handle
     /// @note returns nullptr if doesn't exist
-    std::shared_ptr<shader> get_shader(int shader_id);
+    std::shared_ptr<shader> get_shader(anvil::shader_handle handle);
 
     /// @brief add a shader
-    /// @note allocates memory for it and returns the id of the shader
-    int add_shader(std::shared_ptr<shader> shader);
+    /// @note allocates memory for it and returns the handle of the shader
+    anvil::shader_handle add_shader(std::shared_ptr<shader> shader);
+
+    /// @brief remove a shader
+    /// @note invalidates all handles to it, returns false if the handle was already invalid
+    bool remove_shader(anvil::shader_handle handle);
+
+    /// @brief load a texture in the background
+    /// @note the image is decoded on a worker thread, the upload happens in process_uploads
+    /// @note the future holds an invalid handle if the image could not be loaded or cleanup() was called
+    std::future<anvil::texture_handle> load_texture_async(std::string path);
+
+    /// @brief load a font in the background
+    /// @note the font is baked on a worker thread, the upload happens in process_uploads
+    /// @note the future holds an invalid handle if the font could not be loaded or cleanup() was called
+    std::future<anvil::font_handle> load_font_async(std::string path, int font_size);
+
+    /// @brief load an audio in the background
+    /// @note the audio is decoded on a worker thread, the openal buffer is filled in process_uploads
+    /// @note the future holds an invalid handle if the audio could not be loaded or cleanup() was called
+    std::future<anvil::audio_handle> load_audio_async(std::string path);
+
+    /// @brief load many audios at once, blocks until all are loaded
+    /// @note files are decoded in parallel on the worker threads, the openal buffers are filled on the calling thread as decodes finish
+    /// @note call from the thread owning the audio context
+    /// @return a handle per path in the same order, invalid for files that could not be loaded or were not decoded before cleanup()
+    std::vector<anvil::audio_handle> load_audio_batch(const std::vector<std::string> &paths);
+
+    /// @brief set the cache used to decode audio
+    /// @note reloads of evicted audio and all audio loads go through it, nullptr disables it
+    void set_pcm_cache(std::shared_ptr<anvil::pcm_cache> cache);
+
+    /// @brief get the cache used to decode audio, nullptr if there is none
+    std::shared_ptr<anvil::pcm_cache> get_pcm_cache();
+
+    /// @brief finish loads started with load_*_async
+    /// @note call once per frame from the thread owning the gl context
+    /// @note textures and fonts unloaded off that thread are also freed here
+    /// @note stops once budget is used up but always finishes at least one upload
+    /// @returns amount of uploads still queued
+    std::size_t process_uploads(std::chrono::microseconds budget);
+
+    /// @brief set the memory budget for textures, fonts and audio in bytes
+    /// @note cpu and gpu bytes both count against it, 0 disables the budget
+    /// @note only assets that can be reloaded and are not held outside the manager are evicted
+    /// @note assets still held when the budget was exceeded are evicted on the next load or set_memory_budget(...)
+    void set_memory_budget(std::size_t bytes);
+
+    /// @brief get the memory budget in bytes
+    std::size_t get_memory_budget() const;
+
+    /// @brief get the memory used by loaded assets of a type
+    anvil::memory_usage get_memory_usage(anvil::asset_type type) const;
+
+    /// @brief get the memory used by all loaded assets
+    anvil::memory_usage get_memory_usage() const;
 
     /// @brief creates the audio context
     void init_audio_context();
@@ -545,17 +1887,31 @@ enum class action {
     release = GLFW_RELEASE,
 };
 
+/// @brief the modifiers held during an event, as the glfw bitmask
+struct modifier_mask {
+    int bits = 0;
+
+    /// @brief returns if the modifier is held
+    bool has(modifier m) const { return (bits & static_cast<int>(m)) != 0; }
+
+    /// @brief returns if any modifier is held
+    bool any() const { return bits != 0; }
+
+    bool operator==(const modifier_mask &other) const { return bits == other.bits; }
+    bool operator!=(const modifier_mask &other) const { return bits != other.bits; }
+};
+
 struct key_event {
     keyboard_key key;
     io::action action;
-    std::vector<modifier> modifiers;
+    modifier_mask modifiers;
     int scancode;
 };
 
 struct mouse_event {
     mouse_button button;
     io::action action;
-    std::vector<modifier> modifiers;
+    modifier_mask modifiers;
 };
 
 struct mouse_move_event {
@@ -578,9 +1934,100 @@ void add_listener(mouse_listener_t);
 /// @note the listener will be called on every mouse move event
 void add_listener(mouse_move_listener_t);
 
+enum class input_event_type {
+    key,
+    mouse,
+    mouse_move,
+};
+
+/// @brief an input event recorded in buffered mode, only the member matching type is set
+struct input_event {
+    input_event_type type;
+    /// @brief glfwGetTime() when the callback fired
+    double time;
+    key_event key;
+    mouse_event mouse;
+    mouse_move_event mouse_move;
+};
+
+/// @brief enables or disables buffered input
+/// @note the glfw callbacks queue events during game::poll_events, listeners still fire as before
+/// @note the queue is single consumer, drain it from one thread at a time
+/// @note call it from the thread that calls game::poll_events, coalescing state belongs to that thread only
+/// @note events queued before disabling or changing the capacity are kept and drained first
+/// @note enabling again with the same capacity only changes coalescing
+/// @param capacity events the queue can hold, rounded up to a power of 2, overflow is dropped
+/// @param coalesce_mouse_moves keep only the last of consecutive mouse moves within a frame
+void set_buffered(bool enabled, std::size_t capacity = 1024, bool coalesce_mouse_moves = true);
+
+/// @brief returns if buffered input is enabled
+bool is_buffered();
+
+/// @brief pops the oldest queued event, returns false if there is none
+bool poll_event(input_event &out);
+
+/// @brief appends every queued event to out in order, returns how many were appended
+std::size_t drain_events(std::vector<input_event> &out);
+
+/// @brief returns how many events were dropped because the queue was full
+std::size_t get_dropped_events();
+
+/// @brief keyboard and mouse state for one frame, updated by game::poll_events
+/// @note plain bitsets, so a copy can be handed to another thread as is
+struct input_state {
+    std::bitset<GLFW_KEY_LAST + 1> keys;
+    // edges seen since the last poll, so a press and release within one frame reports both
+    std::bitset<GLFW_KEY_LAST + 1> pressed_keys;
+    std::bitset<GLFW_KEY_LAST + 1> released_keys;
+    std::bitset<GLFW_MOUSE_BUTTON_LAST + 1> buttons;
+    std::bitset<GLFW_MOUSE_BUTTON_LAST + 1> pressed_buttons;
+    std::bitset<GLFW_MOUSE_BUTTON_LAST + 1> released_buttons;
+    vec2d_t mouse_position;
+
+    /// @brief returns if the key is held this frame
+    bool is_down(keyboard_key key) const;
+
+    /// @brief returns if the key went down since the last frame
+    /// @note true even if it went up again within the frame
+    bool was_pressed(keyboard_key key) const;
+
+    /// @brief returns if the key went up since the last frame
+    /// @note true even if it went down again within the frame
+    bool was_released(keyboard_key key) const;
+
+    /// @brief returns if the button is held this frame
+    bool is_down(mouse_button button) const;
+
+    /// @brief returns if the button went down since the last frame
+    bool was_pressed(mouse_button button) const;
+
+    /// @brief returns if the button went up since the last frame
+    bool was_released(mouse_button button) const;
+};
+
+/// @brief returns the input state of the current frame
+/// @note only valid on the thread calling game::poll_events, copy it to use elsewhere
+const input_state &get_input_state();
+
 /// @brief no-listener bool for getting if a key is down or not
+/// @note a bit test on the current frame's input state
 bool is_down(keyboard_key key);
 
+/// @brief returns if the key went down since the last frame
+bool was_pressed(keyboard_key key);
+
+/// @brief returns if the key went up since the last frame
+bool was_released(keyboard_key key);
+
+/// @brief returns if the mouse button is held this frame
+bool is_down(mouse_button button);
+
+/// @brief returns if the mouse button went down since the last frame
+bool was_pressed(mouse_button button);
+
+/// @brief returns if the mouse button went up since the last frame
+bool was_released(mouse_button button);
+
 }
 }
 
@@ -620,6 +2067,26 @@ struct position3d {
     virtual ~position3d() = default;
 };
 
+/// @brief position callback for audio_scene::add_emitter(...) following an entity
+/// @note the entity must outlive the emitter
+template<typename T>
+std::function<anvil::vec3f_t()> follow(const position3d<T> &entity) {
+    return [&entity] {
+        anvil::vec3<T> p = entity.get_position();
+        return anvil::vec3f_t { static_cast<float>(p.x), static_cast<float>(p.y), static_cast<float>(p.z) };
+    };
+}
+
+/// @brief position callback for audio_scene::add_emitter(...) following a 2d entity
+/// @note the entity must outlive the emitter
+template<typename T>
+std::function<anvil::vec3f_t()> follow(const position2d<T> &entity) {
+    return [&entity] {
+        anvil::vec2<T> p = entity.get_position();
+        return anvil::vec3f_t { static_cast<float>(p.x), static_cast<float>(p.y), 0.0f };
+    };
+}
+
 /// @brief extend for health
 template<typename T>
 struct health {
@@ -5,17 +5,30 @@
 #include <GL/glext.h>
 #include <GL/glu.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <csignal>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <iterator>
 #include <memory>
 #include <mutex>
+#include <pthread.h>
 #include <sstream>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <thread>
+#include <unistd.h>
 #include <utility>
 #include <vector>
 
@@ -28,6 +41,10 @@
 
 #include "../include/runtime.hpp"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace util {
 
 std::string format_error(std::string error, int error_id, std::string error_source, std::string level) {
@@ -50,6 +67,9 @@ void signal_handler(int sig) {
 
 std::vector<std::function<void()>> on_close_listeners;
 
+// the thread game::create made the gl context current on
+std::atomic<std::thread::id> gl_thread;
+
 void gl_setup_ortho(anvil::vec2i_t size) {
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
@@ -61,773 +81,4418 @@ void gl_setup_ortho(anvil::vec2i_t size) {
 }
 
 void close_callback(GLFWwindow *) {
-    for (auto l : on_close_listeners) {
+    for (const auto &l : on_close_listeners) {
         l();
     }
 }
 
-}
-
-std::vector<anvil::io::key_listener_t> key_listeners;
-std::vector<anvil::io::mouse_listener_t> mouse_listeners;
-std::vector<anvil::io::mouse_move_listener_t> mouse_move_listeners;
+// takes ownership of vorbis
+bool decode_vorbis(stb_vorbis *vorbis, std::vector<int16_t> &samples, int &channels, int &sample_rate) {
+    stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+    channels = info.channels;
+    sample_rate = info.sample_rate;
 
-namespace anvil {
+    int length = stb_vorbis_stream_length_in_samples(vorbis);
+    samples.resize(static_cast<std::size_t>(length) * channels);
+    int decoded = stb_vorbis_get_samples_short_interleaved(vorbis, channels, samples.data(), static_cast<int>(samples.size()));
+    stb_vorbis_close(vorbis);
 
-void add_segfault_signal_handler() {
-    signal(SIGSEGV, util::signal_handler);
+    samples.resize(static_cast<std::size_t>(decoded) * channels);
+    return true;
 }
 
-bool float_bounding_box::intersects(float_bounding_box &other) {
-    return this->position.x < other.position.x + other.size.x
-            && this->position.x + this->size.x > other.position.x
-            && this->position.y < other.position.y + other.size.y
-            && this->position.y + this->size.y > other.position.y;
+bool decode_vorbis(const std::string &path, std::vector<int16_t> &samples, int &channels, int &sample_rate) {
+    stb_vorbis *vorbis = stb_vorbis_open_filename(path.c_str(), nullptr, nullptr);
+    if (!vorbis) {
+        std::cout << util::format_error("failed to load vorbis file", -1, "stb_vorbis.h - stb_vorbis_open_filename(...)", "error");
+        return false;
+    }
+    return decode_vorbis(vorbis, samples, channels, sample_rate);
 }
 
-bool int_bounding_box::intersects(int_bounding_box &other) {
-    return this->position.x < other.position.x + other.size.x
-            && this->position.x + this->size.x > other.position.x
-            && this->position.y < other.position.y + other.size.y
-            && this->position.y + this->size.y > other.position.y;
+bool decode_vorbis(const uint8_t *bytes, std::size_t length, std::vector<int16_t> &samples, int &channels, int &sample_rate) {
+    stb_vorbis *vorbis = stb_vorbis_open_memory(bytes, static_cast<int>(length), nullptr, nullptr);
+    if (!vorbis) {
+        std::cout << util::format_error("failed to load vorbis data", -1, "stb_vorbis.h - stb_vorbis_open_memory(...)", "error");
+        return false;
+    }
+    return decode_vorbis(vorbis, samples, channels, sample_rate);
 }
 
-}
+// returns nullptr if the file can't be opened or mapped
+const uint8_t *map_file(const std::string &path, std::size_t &size) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
 
-namespace anvil {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    size = static_cast<std::size_t>(st.st_size);
 
-game::game() : title("game window"), window_size({ 800, 600 }) {
-    int ret = glfwInit();
-    if (!ret) {
-        std::cout << util::format_error("glfwInit()", ret, "glfw", "fatal");
-        std::exit(1);
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
     }
+    return static_cast<const uint8_t *>(mapping);
 }
-game::game(std::string title, anvil::vec2i_t size) : title(title), window_size(size) {
-    int ret = glfwInit();
-    if (!ret) {
-        std::cout << util::format_error("glfwInit()", ret, "glfw", "fatal");
-        std::exit(1);
-    }
+
+void unmap_file(const uint8_t *mapping, std::size_t size) {
+    munmap(const_cast<uint8_t *>(mapping), size);
 }
 
-bool game::is_running() { return !glfwWindowShouldClose(this->glfw_window); }
+uint64_t fnv1a64(const char *data, std::size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (std::size_t i = 0; i < length; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
 
-void game::create(bool fs, bool rz, int sp) {
-    if (fs) {
-        GLFWmonitor *monitor = glfwGetPrimaryMonitor();
-        if (monitor == NULL) {
-            std::cout << util::format_error("glfwGetPrimaryMonitor() == NULL", 1, "glfw", "fatal");
-            std::exit(1);
+// averages 2x2 blocks, odd edges reuse the last row or column
+void box_downsample(const uint8_t *src, anvil::vec2i_t src_size, std::vector<uint8_t> &dst, anvil::vec2i_t dst_size, int channels) {
+    dst.resize(static_cast<std::size_t>(dst_size.x) * dst_size.y * channels);
+    for (int y = 0; y < dst_size.y; y++) {
+        const uint8_t *row0 = src + static_cast<std::size_t>(std::min(y * 2, src_size.y - 1)) * src_size.x * channels;
+        const uint8_t *row1 = src + static_cast<std::size_t>(std::min(y * 2 + 1, src_size.y - 1)) * src_size.x * channels;
+        uint8_t *out = dst.data() + static_cast<std::size_t>(y) * dst_size.x * channels;
+        for (int x = 0; x < dst_size.x; x++) {
+            int x0 = std::min(x * 2, src_size.x - 1) * channels;
+            int x1 = std::min(x * 2 + 1, src_size.x - 1) * channels;
+            for (int c = 0; c < channels; c++) {
+                out[x * channels + c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+            }
         }
-        const GLFWvidmode *mode = glfwGetVideoMode(monitor);
-        window_size.x = mode->width;
-        window_size.y = mode->height;
     }
+}
 
-    glfwSetErrorCallback([](int error, const char* description) { std::cout << util::format_error(description, error, "glfw", "fatal"); std::exit(1); });
+// separable resampling weights along one axis, taps per output pixel is fixed
+struct resize_weights {
+    int taps;
+    std::vector<int> first;
+    std::vector<float> weights;
+};
 
-#ifdef ANVIL_RUNTIME_OPENGL_SUPPORT_COMPUTE_SHADER
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-#else
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-#endif
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
-    if (rz) {
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
-    } else {
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+float resize_kernel(anvil::resize_filter filter, float x) {
+    x = std::fabs(x);
+    switch (filter) {
+        case anvil::resize_filter::bilinear:
+            return x < 1.0f ? 1.0f - x : 0.0f;
+        case anvil::resize_filter::bicubic: {
+            // keys, a = -0.5
+            const float a = -0.5f;
+            if (x < 1.0f) {
+                return ((a + 2.0f) * x - (a + 3.0f)) * x * x + 1.0f;
+            } else if (x < 2.0f) {
+                return ((a * x - 5.0f * a) * x + 8.0f * a) * x - 4.0f * a;
+            }
+            return 0.0f;
+        }
+        case anvil::resize_filter::lanczos: {
+            const float pi = 3.14159265358979f;
+            if (x < 1e-5f) {
+                return 1.0f;
+            } else if (x >= 3.0f) {
+                return 0.0f;
+            }
+            return 3.0f * std::sin(pi * x) * std::sin(pi * x / 3.0f) / (pi * pi * x * x);
+        }
+        default:
+            return 0.0f;
     }
-    glfwWindowHint(GLFW_SAMPLES, sp);
-
-    this->glfw_window = glfwCreateWindow(window_size.x, window_size.y, title.c_str(), nullptr, nullptr);
-    glfwMakeContextCurrent(this->glfw_window);
+}
 
-    glfwSetFramebufferSizeCallback(this->glfw_window, [](GLFWwindow* window, int width, int height) {
-        glViewport(0, 0, width, height);
-        util::gl_setup_ortho({width, height});
-    });
+float resize_radius(anvil::resize_filter filter) {
+    switch (filter) {
+        case anvil::resize_filter::bilinear: return 1.0f;
+        case anvil::resize_filter::bicubic: return 2.0f;
+        case anvil::resize_filter::lanczos: return 3.0f;
+        default: return 0.5f;
+    }
+}
 
-    glfwSetKeyCallback(this->glfw_window, [](GLFWwindow *window, int key, int scancode, int action, int mods) {
-        io::key_event event;
-        event.key = static_cast<io::keyboard_key>(key);
-        event.scancode = scancode;
-        event.action = static_cast<io::action>(action);
-        if (mods & GLFW_MOD_SHIFT) {
-            event.modifiers.push_back(anvil::io::modifier::shift);
-        }
-        if (mods & GLFW_MOD_CONTROL) {
-            event.modifiers.push_back(anvil::io::modifier::control);
-        }
-        if (mods & GLFW_MOD_ALT) {
-            event.modifiers.push_back(anvil::io::modifier::alt);
+// taps that would fall outside the source are dropped and the rest renormalized
+resize_weights make_resize_weights(anvil::resize_filter filter, int src, int dst) {
+    float scale = static_cast<float>(src) / static_cast<float>(dst);
+    // widen the kernel when downscaling so every source pixel contributes
+    float stretch = std::max(scale, 1.0f);
+    float support = resize_radius(filter) * stretch;
+
+    resize_weights w;
+    w.taps = static_cast<int>(std::ceil(support)) * 2 + 1;
+    w.first.resize(dst);
+    w.weights.assign(static_cast<std::size_t>(dst) * w.taps, 0.0f);
+    for (int i = 0; i < dst; i++) {
+        float center = (i + 0.5f) * scale - 0.5f;
+        int left = static_cast<int>(std::floor(center - support)) + 1;
+        left = std::max(0, std::min(left, src - w.taps));
+        if (src < w.taps) {
+            left = 0;
         }
-        if (mods & GLFW_MOD_SUPER) {
-            event.modifiers.push_back(anvil::io::modifier::super);
+        w.first[i] = left;
+
+        float *row = &w.weights[static_cast<std::size_t>(i) * w.taps];
+        float total = 0.0f;
+        for (int t = 0; t < w.taps; t++) {
+            int j = left + t;
+            if (j >= src) {
+                break;
+            }
+            row[t] = resize_kernel(filter, (j - center) / stretch);
+            total += row[t];
         }
-        if (mods & GLFW_MOD_CAPS_LOCK) {
-            event.modifiers.push_back(anvil::io::modifier::caps_lock);
+        if (total != 0.0f) {
+            for (int t = 0; t < w.taps; t++) {
+                row[t] /= total;
+            }
+        } else {
+            row[std::min(static_cast<int>(center + 0.5f), src - 1) - left] = 1.0f;
         }
-        if (mods & GLFW_MOD_NUM_LOCK) {
-            event.modifiers.push_back(anvil::io::modifier::num_lock);
+    }
+    return w;
+}
+
+// runs fn(begin, end) over bands of rows, on multiple threads once there's enough work
+void parallel_rows(int rows, std::size_t work, const std::function<void(int, int)> &fn) {
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    if (work < (1u << 20) || threads == 1 || rows < 2) {
+        fn(0, rows);
+        return;
+    }
+    threads = std::min(threads, static_cast<unsigned int>(rows));
+    std::vector<std::thread> bands;
+    int band = (rows + threads - 1) / threads;
+    for (int begin = band; begin < rows; begin += band) {
+        bands.emplace_back(fn, begin, std::min(begin + band, rows));
+    }
+    fn(0, std::min(band, rows));
+    for (auto &t : bands) {
+        t.join();
+    }
+}
+
+// horizontal pass, src is rows of 8 bit pixels and dst rows of float pixels
+void resize_rows(const uint8_t *src, int src_width, float *dst, int dst_width, int channels, const resize_weights &w, int begin, int end) {
+    for (int y = begin; y < end; y++) {
+        const uint8_t *in = src + static_cast<std::size_t>(y) * src_width * channels;
+        float *out = dst + static_cast<std::size_t>(y) * dst_width * channels;
+        for (int x = 0; x < dst_width; x++) {
+            const float *weights = &w.weights[static_cast<std::size_t>(x) * w.taps];
+            const uint8_t *pixel = in + static_cast<std::size_t>(w.first[x]) * channels;
+            int taps = std::min(w.taps, src_width - w.first[x]);
+#if defined(__SSE2__)
+            if (channels == 4) {
+                __m128 acc = _mm_setzero_ps();
+                const __m128i zero = _mm_setzero_si128();
+                for (int t = 0; t < taps; t++) {
+                    int32_t packed;
+                    std::memcpy(&packed, pixel + t * 4, 4);
+                    __m128i widened = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+                    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_cvtepi32_ps(widened), _mm_set1_ps(weights[t])));
+                }
+                _mm_storeu_ps(out + x * 4, acc);
+                continue;
+            }
+#endif
+            for (int c = 0; c < channels; c++) {
+                float acc = 0.0f;
+                for (int t = 0; t < taps; t++) {
+                    acc += pixel[t * channels + c] * weights[t];
+                }
+                out[x * channels + c] = acc;
+            }
         }
-        for (auto listener : key_listeners) {
-            listener(event);
+    }
+}
+
+// vertical pass, combines whole rows so it vectorizes for any channel count
+void resize_columns(const float *src, uint8_t *dst, int row_length, const resize_weights &w, int src_height, int begin, int end) {
+    std::vector<float> acc(row_length);
+    for (int y = begin; y < end; y++) {
+        const float *weights = &w.weights[static_cast<std::size_t>(y) * w.taps];
+        int taps = std::min(w.taps, src_height - w.first[y]);
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for (int t = 0; t < taps; t++) {
+            const float *in = src + static_cast<std::size_t>(w.first[y] + t) * row_length;
+            float weight = weights[t];
+            int i = 0;
+#if defined(__SSE2__)
+            __m128 wv = _mm_set1_ps(weight);
+            for (; i + 4 <= row_length; i += 4) {
+                _mm_storeu_ps(&acc[i], _mm_add_ps(_mm_loadu_ps(&acc[i]), _mm_mul_ps(_mm_loadu_ps(in + i), wv)));
+            }
+#endif
+            for (; i < row_length; i++) {
+                acc[i] += in[i] * weight;
+            }
         }
-    });
 
-    glfwSetMouseButtonCallback(this->glfw_window, [](GLFWwindow *window, int button, int action, int mods) {
-        io::mouse_event event;
-        event.button = static_cast<io::mouse_button>(button);
-        event.action = static_cast<io::action>(action);
-        if (mods & GLFW_MOD_SHIFT) {
-            event.modifiers.push_back(anvil::io::modifier::shift);
+        uint8_t *out = dst + static_cast<std::size_t>(y) * row_length;
+        int i = 0;
+#if defined(__SSE2__)
+        for (; i + 4 <= row_length; i += 4) {
+            // round, then saturate to 0..255 while packing down to bytes
+            __m128i v = _mm_cvtps_epi32(_mm_loadu_ps(&acc[i]));
+            v = _mm_packs_epi32(v, v);
+            v = _mm_packus_epi16(v, v);
+            int32_t packed = _mm_cvtsi128_si32(v);
+            std::memcpy(out + i, &packed, 4);
         }
-        if (mods & GLFW_MOD_CONTROL) {
-            event.modifiers.push_back(anvil::io::modifier::control);
+#endif
+        for (; i < row_length; i++) {
+            out[i] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, std::round(acc[i]))));
         }
-        if (mods & GLFW_MOD_ALT) {
-            event.modifiers.push_back(anvil::io::modifier::alt);
+    }
+}
+
+struct compressed_image {
+    GLenum format;
+    anvil::vec2i_t size;
+
+    // pointer into the file and size of each mip level
+    std::vector<std::pair<const uint8_t *, std::size_t>> levels;
+};
+
+std::size_t compressed_level_size(GLenum format, anvil::vec2i_t size) {
+    std::size_t block_bytes = format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT ? 8 : 16;
+    return static_cast<std::size_t>((size.x + 3) / 4) * ((size.y + 3) / 4) * block_bytes;
+}
+
+uint32_t read_u32(const uint8_t *bytes) {
+    uint32_t value;
+    std::memcpy(&value, bytes, 4);
+    return value;
+}
+
+bool parse_dds(const uint8_t *bytes, std::size_t length, compressed_image &image) {
+    if (length < 128 || std::memcmp(bytes, "DDS ", 4) != 0) {
+        return false;
+    }
+    image.size = { static_cast<int>(read_u32(bytes + 16)), static_cast<int>(read_u32(bytes + 12)) };
+    uint32_t level_count = std::max(read_u32(bytes + 28), 1u);
+    std::size_t offset = 128;
+
+    const uint8_t *fourcc = bytes + 84;
+    if (std::memcmp(fourcc, "DXT1", 4) == 0) {
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    } else if (std::memcmp(fourcc, "DXT5", 4) == 0) {
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    } else if (std::memcmp(fourcc, "DX10", 4) == 0) {
+        if (length < 148) {
+            return false;
         }
-        if (mods & GLFW_MOD_SUPER) {
-            event.modifiers.push_back(anvil::io::modifier::super);
+        // DXGI_FORMAT values
+        switch (read_u32(bytes + 128)) {
+            case 71: image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+            case 77: image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+            case 98: image.format = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
+            default: return false;
         }
-        if (mods & GLFW_MOD_CAPS_LOCK) {
-            event.modifiers.push_back(anvil::io::modifier::caps_lock);
+        offset = 148;
+    } else {
+        return false;
+    }
+
+    image.levels.clear();
+    anvil::vec2i_t level_size = image.size;
+    for (uint32_t i = 0; i < level_count; i++) {
+        std::size_t level_bytes = compressed_level_size(image.format, level_size);
+        if (offset + level_bytes > length) {
+            return false;
         }
-        if (mods & GLFW_MOD_NUM_LOCK) {
-            event.modifiers.push_back(anvil::io::modifier::num_lock);
+        image.levels.push_back({ bytes + offset, level_bytes });
+        offset += level_bytes;
+        level_size = { std::max(level_size.x / 2, 1), std::max(level_size.y / 2, 1) };
+    }
+    return image.size.x > 0 && image.size.y > 0;
+}
+
+// ktx 1.1, little endian only
+bool parse_ktx(const uint8_t *bytes, std::size_t length, compressed_image &image) {
+    static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+    if (length < 64 || std::memcmp(bytes, identifier, 12) != 0 || read_u32(bytes + 12) != 0x04030201) {
+        return false;
+    }
+    image.format = read_u32(bytes + 28);
+    if (image.format != GL_COMPRESSED_RGBA_S3TC_DXT1_EXT && image.format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+            && image.format != GL_COMPRESSED_RGBA_BPTC_UNORM) {
+        return false;
+    }
+    image.size = { static_cast<int>(read_u32(bytes + 36)), static_cast<int>(read_u32(bytes + 40)) };
+    uint32_t level_count = std::max(read_u32(bytes + 56), 1u);
+    std::size_t offset = 64 + static_cast<std::size_t>(read_u32(bytes + 60));
+
+    image.levels.clear();
+    for (uint32_t i = 0; i < level_count; i++) {
+        if (offset + 4 > length) {
+            return false;
         }
-        for (auto listener : mouse_listeners) {
-            listener(event);
+        std::size_t level_bytes = read_u32(bytes + offset);
+        offset += 4;
+        if (offset + level_bytes > length) {
+            return false;
         }
-    });
+        image.levels.push_back({ bytes + offset, level_bytes });
+        offset += (level_bytes + 3) & ~std::size_t(3);
+    }
+    return image.size.x > 0 && image.size.y > 0;
+}
 
-    glfwSetCursorPosCallback(this->glfw_window, [](GLFWwindow *window, double xpos, double ypos) {
-        io::mouse_move_event event;
-        event.position.x = xpos;
-        event.position.y = ypos;
-        for (auto listener : mouse_move_listeners) {
-            listener(event);
-        }
-    });
+struct texture_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t path_length;
+    int32_t width;
+    int32_t height;
+    int64_t source_mtime;
+    uint64_t source_size;
+    uint64_t pixels_offset;
+};
 
-    glfwSetWindowCloseCallback(this->glfw_window, util::close_callback);
+bool stat_source(const std::string &source, int64_t &mtime, uint64_t &size) {
+    struct stat st;
+    if (stat(source.c_str(), &st) != 0) {
+        return false;
+    }
+    mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    size = static_cast<uint64_t>(st.st_size);
+    return true;
 }
 
-anvil::vec2i_t game::get_window_size() {
-    if (window_size.x == 0 || window_size.y == 0) {
-        int x;
-        int y;
-        glfwGetWindowSize(this->glfw_window, &x, &y);
-        window_size = { x, y };
+// returns nullptr if the entry is missing or stale, otherwise the mapping which the caller must unmap
+const uint8_t *map_cache_entry(const std::string &entry, const std::string &source, std::size_t &mapping_size) {
+    int64_t mtime;
+    uint64_t size;
+    if (!stat_source(source, mtime, size)) {
+        return nullptr;
     }
-    return window_size;
-}
 
-std::string game::get_window_title() {
-    return title;
+    const uint8_t *mapping = util::map_file(entry, mapping_size);
+    if (!mapping) {
+        return nullptr;
+    }
+
+    const texture_cache_header *h = reinterpret_cast<const texture_cache_header *>(mapping);
+    bool valid = mapping_size >= sizeof(texture_cache_header)
+            && std::memcmp(h->magic, "ANVILTEX", 8) == 0
+            && h->version == 1
+            && h->source_mtime == mtime
+            && h->source_size == size
+            && h->width > 0 && h->height > 0
+            && h->path_length == source.size()
+            && sizeof(texture_cache_header) + h->path_length <= mapping_size
+            // the entry name is a hash of the path, so compare the path itself too
+            && std::memcmp(mapping + sizeof(texture_cache_header), source.data(), source.size()) == 0
+            && h->pixels_offset <= mapping_size
+            && static_cast<uint64_t>(h->width) * h->height * 4 <= mapping_size - h->pixels_offset;
+    if (!valid) {
+        util::unmap_file(mapping, mapping_size);
+        return nullptr;
+    }
+    return mapping;
 }
 
-void game::poll_events() {
-    glfwPollEvents();
-    int x;
-    int y;
-    glfwGetWindowSize(this->glfw_window, &x, &y);
-    window_size = { x, y };
+// single producer single consumer queue, push and pop never block or allocate
+template<typename T>
+class spsc_ring {
+private:
+    std::vector<T> slots;
+    std::size_t mask;
+    // next slot to pop, written by the consumer
+    alignas(64) std::atomic<std::size_t> head { 0 };
+    // next slot to push, written by the producer
+    alignas(64) std::atomic<std::size_t> tail { 0 };
+public:
+    // capacity is rounded up to a power of 2
+    explicit spsc_ring(std::size_t capacity) {
+        std::size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
 
-    title = glfwGetWindowTitle(this->glfw_window);
+    // returns false if the ring is full
+    bool push(T value) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // returns false if the ring is empty
+    bool pop(T &out) {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        out = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+};
+
+// ima adpcm, 4 bits per sample, nibbles in sample order with the low nibble first
+// every channel starts at predictor and step index 0, so there is no header
+namespace adpcm {
+
+constexpr int16_t step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+constexpr int8_t index_table[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+struct channel_state {
+    int predictor = 0;
+    int index = 0;
+
+    // applies a nibble and returns the new sample, shared by encoder and decoder so they never drift
+    int16_t step(uint8_t nibble) {
+        int step = step_table[index];
+        int diff = step >> 3;
+        if (nibble & 4) diff += step;
+        if (nibble & 2) diff += step >> 1;
+        if (nibble & 1) diff += step >> 2;
+        predictor += nibble & 8 ? -diff : diff;
+        predictor = std::max(-32768, std::min(32767, predictor));
+        index = std::max(0, std::min(88, index + index_table[nibble]));
+        return static_cast<int16_t>(predictor);
+    }
+};
+
+std::vector<uint8_t> encode(const int16_t *samples, int channels, std::size_t frames) {
+    std::size_t count = frames * channels;
+    std::vector<uint8_t> out((count + 1) / 2, 0);
+    std::vector<channel_state> state(channels);
+    for (std::size_t i = 0; i < count; i++) {
+        channel_state &s = state[i % channels];
+        int diff = samples[i] - s.predictor;
+        uint8_t nibble = 0;
+        if (diff < 0) {
+            nibble = 8;
+            diff = -diff;
+        }
+        int step = step_table[s.index];
+        if (diff >= step) { nibble |= 4; diff -= step; }
+        step >>= 1;
+        if (diff >= step) { nibble |= 2; diff -= step; }
+        step >>= 1;
+        if (diff >= step) { nibble |= 1; }
+        s.step(nibble);
+        out[i / 2] |= i & 1 ? nibble << 4 : nibble;
+    }
+    return out;
 }
 
-void game::register_on_close(std::function<void()> func) {
-    util::on_close_listeners.push_back(func);
+void decode(const uint8_t *data, int channels, std::size_t frames, int16_t *samples) {
+    std::size_t count = frames * channels;
+    std::vector<channel_state> state(channels);
+    for (std::size_t i = 0; i < count; i++) {
+        uint8_t nibble = i & 1 ? data[i / 2] >> 4 : data[i / 2] & 15;
+        samples[i] = state[i % channels].step(nibble);
+    }
 }
 
-void game::close() {
-    glfwTerminate();
 }
-game::~game() { close(); }
 
-struct __compiledshaderobj {
-    int original_shader_id;
+// lz4 block format, see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+namespace lz4 {
 
-    GLuint id;
-    GLuint program;
-};
+constexpr std::size_t min_match = 4;
+constexpr std::size_t last_literals = 5;  // the last 5 bytes are always literals
+constexpr std::size_t match_find_limit = 12;  // the last match starts at least 12 bytes before the end
 
-void renderer_2d::draw_texture(anvil::texture texture, anvil::vec2f_t pos, anvil::vec2i_t size) {
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, texture.tid);
-    glColor4f(1, 1, 1, 1);
-    glBegin(GL_QUADS);
-    {
-        glTexCoord2f(0.0f, 0.0f); glVertex2f(pos.x, pos.y);
-        glTexCoord2f(1.0f, 0.0f); glVertex2f(pos.x + size.x, pos.y);
-        glTexCoord2f(1.0f, 1.0f); glVertex2f(pos.x + size.x, pos.y + size.y);
-        glTexCoord2f(0.0f, 1.0f); glVertex2f(pos.x, pos.y + size.y);
+void write_length(std::vector<uint8_t> &out, std::size_t length) {
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
     }
-    glEnd();
+    out.push_back(static_cast<uint8_t>(length));
+}
 
-    triangle_count += 2;
+std::vector<uint8_t> compress(const uint8_t *src, std::size_t length) {
+    std::vector<uint8_t> out;
+    out.reserve(length + length / 255 + 16);
+
+    auto read32 = [src](std::size_t i) {
+        uint32_t v;
+        std::memcpy(&v, src + i, sizeof(v));
+        return v;
+    };
+
+    // positions + 1 of the last occurrence of each hashed 4 byte sequence, 0 is empty
+    std::vector<uint32_t> table(1 << 16, 0);
+
+    std::size_t anchor = 0;
+    std::size_t ip = 0;
+    if (length > match_find_limit) {
+        std::size_t limit = length - match_find_limit;
+        while (ip < limit) {
+            uint32_t sequence = read32(ip);
+            uint32_t h = (sequence * 2654435761u) >> 16;
+            std::size_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(ip + 1);
+
+            if (candidate == 0 || ip - (candidate - 1) > 65535 || read32(candidate - 1) != sequence) {
+                ip++;
+                continue;
+            }
+            std::size_t ref = candidate - 1;
 
-    glDisable(GL_TEXTURE_2D);
-}
+            std::size_t match = min_match;
+            std::size_t max_match = length - last_literals - ip;
+            while (match < max_match && src[ref + match] == src[ip + match]) {
+                match++;
+            }
 
-void renderer_2d::run_shader(anvil::shader shader) {
-    for (auto &os : compiled_shaders) {
-        if (os.original_shader_id == shader.id) {
-            glUseProgram(os.program);
-            return;
+            std::size_t literals = ip - anchor;
+            uint8_t token = static_cast<uint8_t>((std::min<std::size_t>(literals, 15) << 4) | std::min<std::size_t>(match - min_match, 15));
+            out.push_back(token);
+            if (literals >= 15) {
+                write_length(out, literals - 15);
+            }
+            out.insert(out.end(), src + anchor, src + ip);
+
+            std::size_t offset = ip - ref;
+            out.push_back(static_cast<uint8_t>(offset & 0xff));
+            out.push_back(static_cast<uint8_t>(offset >> 8));
+            if (match - min_match >= 15) {
+                write_length(out, match - min_match - 15);
+            }
+
+            ip += match;
+            anchor = ip;
         }
     }
-    __compiledshaderobj compiled;
 
-    compiled.original_shader_id = shader.id;
-    
-    GLenum shader_type;
-    if (shader.type == anvil::shader_type::vertex) {
-        shader_type = GL_VERTEX_SHADER;
-    } else if (shader.type == anvil::shader_type::fragment) {
-        shader_type = GL_FRAGMENT_SHADER;
-    } else if (shader.type == anvil::shader_type::tesselation_control) {
-        shader_type = GL_TESS_CONTROL_SHADER;
-    } else if (shader.type == anvil::shader_type::tesselation_evaluation) {
-        shader_type = GL_TESS_EVALUATION_SHADER;
-    } else if (shader.type == anvil::shader_type::geometry) {
-        shader_type = GL_GEOMETRY_SHADER;
-    }
-#ifdef ANVIL_RUNTIME_OPENGL_SUPPORT_COMPUTE_SHADER
-    else if (shader.type == anvil::shader_type::compute) {
-        shader_type = GL_COMPUTE_SHADER;
-    }
-#endif
-    else {
-        std::cout << util::format_error("unknown shader type", -1, "anvil::renderer_2d::run_shader()", "warning") << '\n';
+    std::size_t literals = length - anchor;
+    out.push_back(static_cast<uint8_t>(std::min<std::size_t>(literals, 15) << 4));
+    if (literals >= 15) {
+        write_length(out, literals - 15);
     }
+    out.insert(out.end(), src + anchor, src + length);
+    return out;
+}
 
-    compiled.id = glCreateShader(shader_type);
+// returns false on malformed input instead of reading or writing out of bounds
+bool decompress(const uint8_t *src, std::size_t src_length, uint8_t *dst, std::size_t dst_length) {
+    std::size_t ip = 0;
+    std::size_t op = 0;
 
-    const char *source = shader.glsl_code.c_str();
+    auto read_length = [&](std::size_t &length) {
+        uint8_t b;
+        do {
+            if (ip >= src_length) {
+                return false;
+            }
+            b = src[ip++];
+            length += b;
+        } while (b == 255);
+        return true;
+    };
+
+    while (ip < src_length) {
+        uint8_t token = src[ip++];
+
+        std::size_t literals = token >> 4;
+        if (literals == 15 && !read_length(literals)) {
+            return false;
+        }
+        if (literals > src_length - ip || literals > dst_length - op) {
+            return false;
+        }
+        std::memcpy(dst + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+
+        // the last sequence has no match
+        if (ip == src_length) {
+            break;
+        }
+
+        if (src_length - ip < 2) {
+            return false;
+        }
+        std::size_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return false;
+        }
+
+        std::size_t match = token & 15;
+        if (match == 15 && !read_length(match)) {
+            return false;
+        }
+        match += min_match;
+        if (match > dst_length - op) {
+            return false;
+        }
+
+        // byte by byte since the match may overlap what it is writing
+        for (std::size_t i = 0; i < match; i++) {
+            dst[op + i] = dst[op - offset + i];
+        }
+        op += match;
+    }
+    return op == dst_length;
+}
+
+}
+
+// zlib stream with stored or fixed huffman deflate blocks, see rfc 1950 and 1951
+namespace deflate {
+
+struct bit_writer {
+    std::vector<uint8_t> &out;
+    uint64_t bits = 0;
+    int count = 0;
+
+    // deflate packs bits starting at the least significant one
+    void write(uint32_t value, int length) {
+        bits |= static_cast<uint64_t>(value) << count;
+        count += length;
+        while (count >= 8) {
+            out.push_back(static_cast<uint8_t>(bits));
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    // huffman codes are defined most significant bit first
+    void write_code(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++) {
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        }
+        write(reversed, length);
+    }
+
+    void flush() {
+        if (count > 0) {
+            out.push_back(static_cast<uint8_t>(bits));
+        }
+        bits = 0;
+        count = 0;
+    }
+};
+
+constexpr uint16_t length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+constexpr uint8_t length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+constexpr uint16_t distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+constexpr uint8_t distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+constexpr std::size_t window = 32768;
+constexpr std::size_t min_match = 3;
+constexpr std::size_t max_match = 258;
+
+void write_literal(bit_writer &w, uint32_t symbol) {
+    if (symbol < 144) {
+        w.write_code(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        w.write_code(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        w.write_code(symbol - 256, 7);
+    } else {
+        w.write_code(0xc0 + symbol - 280, 8);
+    }
+}
+
+void write_match(bit_writer &w, std::size_t length, std::size_t distance) {
+    int l = 28;
+    while (length_base[l] > length) {
+        l--;
+    }
+    write_literal(w, 257 + l);
+    w.write(static_cast<uint32_t>(length - length_base[l]), length_extra[l]);
+
+    int d = 29;
+    while (distance_base[d] > distance) {
+        d--;
+    }
+    w.write_code(d, 5);
+    w.write(static_cast<uint32_t>(distance - distance_base[d]), distance_extra[d]);
+}
+
+uint32_t adler32(const uint8_t *data, std::size_t length) {
+    uint32_t a = 1, b = 0;
+    while (length > 0) {
+        // largest block that can't overflow b before the modulo
+        std::size_t block = std::min<std::size_t>(length, 5552);
+        for (std::size_t i = 0; i < block; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += block;
+        length -= block;
+    }
+    return (b << 16) | a;
+}
+
+// level 0 stores, 1 to 9 trade speed for longer match searches
+std::vector<uint8_t> compress(const uint8_t *src, std::size_t length, int level) {
+    std::vector<uint8_t> out;
+    out.reserve(length / 2 + 64);
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    if (level <= 0) {
+        std::size_t offset = 0;
+        do {
+            std::size_t block = std::min<std::size_t>(length - offset, 65535);
+            out.push_back(offset + block == length ? 1 : 0);
+            out.push_back(static_cast<uint8_t>(block));
+            out.push_back(static_cast<uint8_t>(block >> 8));
+            out.push_back(static_cast<uint8_t>(~block));
+            out.push_back(static_cast<uint8_t>(~block >> 8));
+            out.insert(out.end(), src + offset, src + offset + block);
+            offset += block;
+        } while (offset < length);
+    } else {
+        const int max_chain = 4 << (std::min(level, 9) / 2);
+        const std::size_t hash_size = 1 << 15;
+        std::vector<int32_t> head(hash_size, -1);
+        std::vector<int32_t> previous(window, -1);
+        auto hash = [&](std::size_t i) {
+            return ((src[i] << 10) ^ (src[i + 1] << 5) ^ src[i + 2]) & (hash_size - 1);
+        };
+        auto insert = [&](std::size_t i) {
+            std::size_t h = hash(i);
+            previous[i & (window - 1)] = head[h];
+            head[h] = static_cast<int32_t>(i);
+        };
+
+        bit_writer w { out };
+        // a single final block with the fixed codes
+        w.write(1, 1);
+        w.write(1, 2);
+        std::size_t i = 0;
+        while (i < length) {
+            std::size_t best_length = 0, best_distance = 0;
+            if (i + min_match <= length) {
+                std::size_t limit = std::min(max_match, length - i);
+                int32_t candidate = head[hash(i)];
+                for (int chain = 0; candidate >= 0 && i - candidate <= window - 1 && chain < max_chain; chain++) {
+                    const uint8_t *a = src + candidate;
+                    const uint8_t *b = src + i;
+                    if (a[best_length] == b[best_length]) {
+                        std::size_t n = 0;
+                        while (n < limit && a[n] == b[n]) {
+                            n++;
+                        }
+                        if (n > best_length) {
+                            best_length = n;
+                            best_distance = i - candidate;
+                            if (n == limit) {
+                                break;
+                            }
+                        }
+                    }
+                    int32_t next = previous[candidate & (window - 1)];
+                    if (next >= candidate) {
+                        break;
+                    }
+                    candidate = next;
+                }
+            }
+
+            if (best_length >= min_match) {
+                write_match(w, best_length, best_distance);
+                for (std::size_t end = i + best_length; i < end; i++) {
+                    if (i + min_match <= length) {
+                        insert(i);
+                    }
+                }
+            } else {
+                write_literal(w, src[i]);
+                if (i + min_match <= length) {
+                    insert(i);
+                }
+                i++;
+            }
+        }
+        write_literal(w, 256);
+        w.flush();
+    }
+
+    uint32_t adler = adler32(src, length);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(adler >> shift));
+    }
+    return out;
+}
+
+}
+
+namespace png {
+
+uint32_t crc32(const uint8_t *data, std::size_t length, uint32_t crc = 0) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (std::size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void write_u32(std::vector<uint8_t> &out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void write_chunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, std::size_t length) {
+    write_u32(out, static_cast<uint32_t>(length));
+    std::size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + length);
+    write_u32(out, crc32(out.data() + start, length + 4));
+}
+
+uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uint8_t>(a);
+    }
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+// applies png filter type to one row, previous is all zero for the first row
+void filter_row(int type, const uint8_t *row, const uint8_t *previous, std::size_t stride, int bpp, uint8_t *out) {
+    for (std::size_t i = 0; i < stride; i++) {
+        int a = i >= static_cast<std::size_t>(bpp) ? row[i - bpp] : 0;
+        int b = previous[i];
+        int c = i >= static_cast<std::size_t>(bpp) ? previous[i - bpp] : 0;
+        switch (type) {
+            case 0: out[i] = row[i]; break;
+            case 1: out[i] = static_cast<uint8_t>(row[i] - a); break;
+            case 2: out[i] = static_cast<uint8_t>(row[i] - b); break;
+            case 3: out[i] = static_cast<uint8_t>(row[i] - ((a + b) >> 1)); break;
+            default: out[i] = static_cast<uint8_t>(row[i] - paeth(a, b, c)); break;
+        }
+    }
+}
+
+// level 0 stores unfiltered, 1 to 3 always use the up filter, higher levels pick the filter per row
+std::vector<uint8_t> encode(const uint8_t *pixels, anvil::vec2i_t size, int channels, int level) {
+    std::size_t stride = static_cast<std::size_t>(size.x) * channels;
+    std::vector<uint8_t> filtered((stride + 1) * size.y);
+    std::vector<uint8_t> zero(stride, 0), candidate(stride);
+    for (int y = 0; y < size.y; y++) {
+        const uint8_t *row = pixels + y * stride;
+        const uint8_t *previous = y > 0 ? row - stride : zero.data();
+        uint8_t *out = &filtered[y * (stride + 1)];
+
+        int type = level <= 0 ? 0 : 2;
+        if (level > 3) {
+            // minimum sum of absolute differences heuristic
+            uint64_t best = UINT64_MAX;
+            for (int t = 0; t < 5; t++) {
+                filter_row(t, row, previous, stride, channels, candidate.data());
+                uint64_t sum = 0;
+                for (uint8_t v : candidate) {
+                    sum += v < 128 ? v : 256 - v;
+                }
+                if (sum < best) {
+                    best = sum;
+                    type = t;
+                }
+            }
+        }
+        out[0] = static_cast<uint8_t>(type);
+        filter_row(type, row, previous, stride, channels, out + 1);
+    }
+
+    std::vector<uint8_t> out = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<uint8_t> header;
+    write_u32(header, size.x);
+    write_u32(header, size.y);
+    // 8 bit depth, truecolor with or without alpha, deflate, adaptive filtering, no interlace
+    header.insert(header.end(), { 8, static_cast<uint8_t>(channels == 4 ? 6 : 2), 0, 0, 0 });
+    write_chunk(out, "IHDR", header.data(), header.size());
+
+    std::vector<uint8_t> compressed = deflate::compress(filtered.data(), filtered.size(), level);
+    write_chunk(out, "IDAT", compressed.data(), compressed.size());
+    write_chunk(out, "IEND", nullptr, 0);
+    return out;
+}
+
+}
+
+// the quite ok image format, see https://qoiformat.org/qoi-specification.pdf
+namespace qoi {
+
+std::vector<uint8_t> encode(const uint8_t *pixels, anvil::vec2i_t size, int channels) {
+    std::vector<uint8_t> out;
+    out.reserve(14 + static_cast<std::size_t>(size.x) * size.y * (channels + 1) + 8);
+    out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+    png::write_u32(out, size.x);
+    png::write_u32(out, size.y);
+    out.push_back(static_cast<uint8_t>(channels));
+    // srgb with linear alpha
+    out.push_back(0);
+
+    uint8_t index[64][4] = {};
+    uint8_t px[4] = { 0, 0, 0, 255 };
+    uint8_t prev[4] = { 0, 0, 0, 255 };
+    int run = 0;
+    std::size_t count = static_cast<std::size_t>(size.x) * size.y;
+    for (std::size_t i = 0; i < count; i++) {
+        std::memcpy(px, pixels + i * channels, channels);
+
+        if (std::memcmp(px, prev, 4) == 0) {
+            run++;
+            if (run == 62 || i + 1 == count) {
+                out.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));
+            run = 0;
+        }
+
+        int slot = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+        if (std::memcmp(index[slot], px, 4) == 0) {
+            out.push_back(static_cast<uint8_t>(slot));
+        } else {
+            std::memcpy(index[slot], px, 4);
+            if (px[3] == prev[3]) {
+                int8_t dr = static_cast<int8_t>(px[0] - prev[0]);
+                int8_t dg = static_cast<int8_t>(px[1] - prev[1]);
+                int8_t db = static_cast<int8_t>(px[2] - prev[2]);
+                int8_t dr_dg = static_cast<int8_t>(dr - dg);
+                int8_t db_dg = static_cast<int8_t>(db - dg);
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    out.push_back(static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                    out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+                    out.push_back(static_cast<uint8_t>((dr_dg + 8) << 4 | (db_dg + 8)));
+                } else {
+                    out.insert(out.end(), { 0xfe, px[0], px[1], px[2] });
+                }
+            } else {
+                out.insert(out.end(), { 0xff, px[0], px[1], px[2], px[3] });
+            }
+        }
+        std::memcpy(prev, px, 4);
+    }
+    out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+    return out;
+}
+
+}
+}
+
+std::vector<anvil::io::key_listener_t> key_listeners;
+std::vector<anvil::io::mouse_listener_t> mouse_listeners;
+std::vector<anvil::io::mouse_move_listener_t> mouse_move_listeners;
+// written by the glfw callbacks, the pressed_* and released_* edges are cleared in game::poll_events
+anvil::io::input_state input_snapshot;
+
+namespace anvil {
+
+// for buffered input
+struct __inputqueue {
+    util::spsc_ring<anvil::io::input_event> ring;
+    std::size_t capacity;
+
+    // the ring this one replaced, drained first so replacing a ring loses nothing
+    // set before the ring is published, afterwards only the consumer touches it to clear it once empty
+    std::shared_ptr<__inputqueue> previous;
+
+    explicit __inputqueue(std::size_t capacity) : ring(capacity), capacity(capacity) {}
+};
+
+}
+
+// buffered input, swapped with atomic_load/atomic_store
+// input_queue is the ring the callbacks push to, input_retired holds the rings left over after set_buffered(false)
+std::shared_ptr<anvil::__inputqueue> input_queue;
+std::shared_ptr<anvil::__inputqueue> input_retired;
+std::atomic<std::size_t> input_dropped { 0 };
+// coalescing state, only touched on the thread calling game::poll_events and set_buffered
+bool input_coalesce_moves = true;
+// the last mouse move of a frame, held back until another event or the end of poll_events
+bool input_move_pending = false;
+anvil::io::input_event input_pending_move;
+
+namespace util {
+
+void queue_input(const std::shared_ptr<anvil::__inputqueue> &queue, const anvil::io::input_event &event) {
+    if (!queue->ring.push(event)) {
+        input_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// pops from the oldest ring of the chain that still has events
+bool pop_input(const std::shared_ptr<anvil::__inputqueue> &queue, anvil::io::input_event &out) {
+    if (!queue) {
+        return false;
+    }
+    std::shared_ptr<anvil::__inputqueue> previous = std::atomic_load(&queue->previous);
+    if (previous) {
+        if (pop_input(previous, out)) {
+            return true;
+        }
+        // retired rings are never pushed to again, so an empty one can go
+        std::atomic_store(&queue->previous, std::shared_ptr<anvil::__inputqueue>());
+    }
+    return queue->ring.pop(out);
+}
+
+std::shared_ptr<anvil::__inputqueue> input_chain() {
+    std::shared_ptr<anvil::__inputqueue> queue = std::atomic_load(&input_queue);
+    return queue ? queue : std::atomic_load(&input_retired);
+}
+
+void flush_pending_move() {
+    if (!input_move_pending) {
+        return;
+    }
+    input_move_pending = false;
+    auto queue = std::atomic_load(&input_queue);
+    if (queue) {
+        queue_input(queue, input_pending_move);
+    }
+}
+
+void buffer_input(const anvil::io::input_event &event) {
+    auto queue = std::atomic_load(&input_queue);
+    if (!queue) {
+        return;
+    }
+    if (event.type == anvil::io::input_event_type::mouse_move && input_coalesce_moves) {
+        input_pending_move = event;
+        input_move_pending = true;
+        return;
+    }
+    flush_pending_move();
+    queue_input(queue, event);
+}
+
+}
+
+namespace anvil {
+
+void add_segfault_signal_handler() {
+    signal(SIGSEGV, util::signal_handler);
+}
+
+bool float_bounding_box::intersects(float_bounding_box &other) {
+    return this->position.x < other.position.x + other.size.x
+            && this->position.x + this->size.x > other.position.x
+            && this->position.y < other.position.y + other.size.y
+            && this->position.y + this->size.y > other.position.y;
+}
+
+bool int_bounding_box::intersects(int_bounding_box &other) {
+    return this->position.x < other.position.x + other.size.x
+            && this->position.x + this->size.x > other.position.x
+            && this->position.y < other.position.y + other.size.y
+            && this->position.y + this->size.y > other.position.y;
+}
+
+}
+
+namespace anvil {
+
+game::game() : title("game window"), window_size({ 800, 600 }) {
+    int ret = glfwInit();
+    if (!ret) {
+        std::cout << util::format_error("glfwInit()", ret, "glfw", "fatal");
+        std::exit(1);
+    }
+}
+game::game(std::string title, anvil::vec2i_t size) : title(title), window_size(size) {
+    int ret = glfwInit();
+    if (!ret) {
+        std::cout << util::format_error("glfwInit()", ret, "glfw", "fatal");
+        std::exit(1);
+    }
+}
+
+bool game::is_running() { return !glfwWindowShouldClose(this->glfw_window); }
+
+void game::create(bool fs, bool rz, int sp) {
+    if (fs) {
+        GLFWmonitor *monitor = glfwGetPrimaryMonitor();
+        if (monitor == NULL) {
+            std::cout << util::format_error("glfwGetPrimaryMonitor() == NULL", 1, "glfw", "fatal");
+            std::exit(1);
+        }
+        const GLFWvidmode *mode = glfwGetVideoMode(monitor);
+        window_size.x = mode->width;
+        window_size.y = mode->height;
+    }
+
+    glfwSetErrorCallback([](int error, const char* description) { std::cout << util::format_error(description, error, "glfw", "fatal"); std::exit(1); });
+
+#ifdef ANVIL_RUNTIME_OPENGL_SUPPORT_COMPUTE_SHADER
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+#else
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+#endif
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+    if (rz) {
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    } else {
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    }
+    glfwWindowHint(GLFW_SAMPLES, sp);
+
+    this->glfw_window = glfwCreateWindow(window_size.x, window_size.y, title.c_str(), nullptr, nullptr);
+    glfwMakeContextCurrent(this->glfw_window);
+    util::gl_thread = std::this_thread::get_id();
+
+    glfwSetFramebufferSizeCallback(this->glfw_window, [](GLFWwindow* window, int width, int height) {
+        glViewport(0, 0, width, height);
+        util::gl_setup_ortho({width, height});
+    });
+
+    glfwSetKeyCallback(this->glfw_window, [](GLFWwindow *window, int key, int scancode, int action, int mods) {
+        io::key_event event;
+        event.key = static_cast<io::keyboard_key>(key);
+        event.scancode = scancode;
+        event.action = static_cast<io::action>(action);
+        event.modifiers.bits = mods;
+        if (key >= 0 && key <= GLFW_KEY_LAST && action != GLFW_REPEAT) {
+            input_snapshot.keys.set(key, action == GLFW_PRESS);
+            (action == GLFW_PRESS ? input_snapshot.pressed_keys : input_snapshot.released_keys).set(key);
+        }
+        if (io::is_buffered()) {
+            io::input_event buffered {};
+            buffered.type = io::input_event_type::key;
+            buffered.time = glfwGetTime();
+            buffered.key = event;
+            util::buffer_input(buffered);
+        }
+        for (const auto &listener : key_listeners) {
+            listener(event);
+        }
+    });
+
+    glfwSetMouseButtonCallback(this->glfw_window, [](GLFWwindow *window, int button, int action, int mods) {
+        io::mouse_event event;
+        event.button = static_cast<io::mouse_button>(button);
+        event.action = static_cast<io::action>(action);
+        event.modifiers.bits = mods;
+        if (button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST) {
+            input_snapshot.buttons.set(button, action == GLFW_PRESS);
+            (action == GLFW_PRESS ? input_snapshot.pressed_buttons : input_snapshot.released_buttons).set(button);
+        }
+        if (io::is_buffered()) {
+            io::input_event buffered {};
+            buffered.type = io::input_event_type::mouse;
+            buffered.time = glfwGetTime();
+            buffered.mouse = event;
+            util::buffer_input(buffered);
+        }
+        for (const auto &listener : mouse_listeners) {
+            listener(event);
+        }
+    });
+
+    glfwSetCursorPosCallback(this->glfw_window, [](GLFWwindow *window, double xpos, double ypos) {
+        io::mouse_move_event event;
+        event.position.x = xpos;
+        event.position.y = ypos;
+        input_snapshot.mouse_position = event.position;
+        if (io::is_buffered()) {
+            io::input_event buffered {};
+            buffered.type = io::input_event_type::mouse_move;
+            buffered.time = glfwGetTime();
+            buffered.mouse_move = event;
+            util::buffer_input(buffered);
+        }
+        for (const auto &listener : mouse_move_listeners) {
+            listener(event);
+        }
+    });
+
+    // release callbacks are not delivered while unfocused, so drop everything held
+    glfwSetWindowFocusCallback(this->glfw_window, [](GLFWwindow *, int focused) {
+        if (!focused) {
+            input_snapshot.released_keys |= input_snapshot.keys;
+            input_snapshot.released_buttons |= input_snapshot.buttons;
+            input_snapshot.keys.reset();
+            input_snapshot.buttons.reset();
+        }
+    });
+
+    glfwSetWindowCloseCallback(this->glfw_window, util::close_callback);
+}
+
+anvil::vec2i_t game::get_window_size() {
+    if (window_size.x == 0 || window_size.y == 0) {
+        int x;
+        int y;
+        glfwGetWindowSize(this->glfw_window, &x, &y);
+        window_size = { x, y };
+    }
+    return window_size;
+}
+
+std::string game::get_window_title() {
+    return title;
+}
+
+void game::poll_events() {
+    input_snapshot.pressed_keys.reset();
+    input_snapshot.released_keys.reset();
+    input_snapshot.pressed_buttons.reset();
+    input_snapshot.released_buttons.reset();
+    glfwPollEvents();
+    util::flush_pending_move();
+    int x;
+    int y;
+    glfwGetWindowSize(this->glfw_window, &x, &y);
+    window_size = { x, y };
+
+    title = glfwGetWindowTitle(this->glfw_window);
+}
+
+void game::register_on_close(std::function<void()> func) {
+    util::on_close_listeners.push_back(func);
+}
+
+void game::close() {
+    glfwTerminate();
+}
+game::~game() { close(); }
+
+struct __compiledshaderobj {
+    anvil::shader_handle original_shader;
+
+    // shaders that were never added to an asset manager all share the invalid handle, those are matched by source
+    anvil::shader_type type;
+    std::string source;
+
+    GLuint id;
+    GLuint program;
+};
+
+void renderer_2d::draw_texture(const anvil::texture &texture, anvil::vec2f_t pos, anvil::vec2i_t size) {
+    const anvil::texture *drawn = &texture;
+    if (!texture.ready) {
+        if (!placeholder_texture || !placeholder_texture->ready) {
+            return;
+        }
+        drawn = placeholder_texture.get();
+    }
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, drawn->tid);
+    glColor4f(1, 1, 1, 1);
+    glBegin(GL_QUADS);
+    {
+        glTexCoord2f(0.0f, 0.0f); glVertex2f(pos.x, pos.y);
+        glTexCoord2f(1.0f, 0.0f); glVertex2f(pos.x + size.x, pos.y);
+        glTexCoord2f(1.0f, 1.0f); glVertex2f(pos.x + size.x, pos.y + size.y);
+        glTexCoord2f(0.0f, 1.0f); glVertex2f(pos.x, pos.y + size.y);
+    }
+    glEnd();
+
+    triangle_count += 2;
+
+    glDisable(GL_TEXTURE_2D);
+}
+
+void renderer_2d::placeholder(std::shared_ptr<anvil::texture> texture) {
+    placeholder_texture = texture;
+}
+
+void renderer_2d::draw_texture(anvil::asset_manager &assets, anvil::texture_handle handle, anvil::vec2f_t pos, anvil::vec2i_t size) {
+    std::shared_ptr<anvil::texture> texture = assets.get_texture(handle);
+    if (!texture) {
+        return;
+    }
+    draw_texture(*texture, pos, size);
+}
+
+void renderer_2d::run_shader(anvil::shader shader) {
+    bool managed = shader.handle.valid();
+    for (auto &os : compiled_shaders) {
+        bool match = managed
+            ? os.original_shader == shader.handle
+            : !os.original_shader.valid() && os.type == shader.type && os.source == shader.glsl_code;
+        if (match) {
+            glUseProgram(os.program);
+            return;
+        }
+    }
+    __compiledshaderobj compiled;
+
+    compiled.original_shader = shader.handle;
+    compiled.type = shader.type;
+    if (!managed) {
+        compiled.source = shader.glsl_code;
+    }
+    
+    GLenum shader_type;
+    if (shader.type == anvil::shader_type::vertex) {
+        shader_type = GL_VERTEX_SHADER;
+    } else if (shader.type == anvil::shader_type::fragment) {
+        shader_type = GL_FRAGMENT_SHADER;
+    } else if (shader.type == anvil::shader_type::tesselation_control) {
+        shader_type = GL_TESS_CONTROL_SHADER;
+    } else if (shader.type == anvil::shader_type::tesselation_evaluation) {
+        shader_type = GL_TESS_EVALUATION_SHADER;
+    } else if (shader.type == anvil::shader_type::geometry) {
+        shader_type = GL_GEOMETRY_SHADER;
+    }
+#ifdef ANVIL_RUNTIME_OPENGL_SUPPORT_COMPUTE_SHADER
+    else if (shader.type == anvil::shader_type::compute) {
+        shader_type = GL_COMPUTE_SHADER;
+    }
+#endif
+    else {
+        std::cout << util::format_error("unknown shader type", -1, "anvil::renderer_2d::run_shader()", "warning") << '\n';
+    }
+
+    compiled.id = glCreateShader(shader_type);
+
+    const char *source = shader.glsl_code.c_str();
     glShaderSource(compiled.id, 1, &source, nullptr);
     glCompileShader(compiled.id);
 
-    GLint success;
-    glGetShaderiv(compiled.id, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        GLchar info_log[512];
-        glGetShaderInfoLog(compiled.id, 512, nullptr, info_log);
-        std::cout << util::format_error(info_log, -1, "anvil::renderer_2d::run_shader()", "fatal") << '\n';
+    GLint success;
+    glGetShaderiv(compiled.id, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        GLchar info_log[512];
+        glGetShaderInfoLog(compiled.id, 512, nullptr, info_log);
+        std::cout << util::format_error(info_log, -1, "anvil::renderer_2d::run_shader()", "fatal") << '\n';
+        std::exit(1);
+    }
+
+    compiled.program = glCreateProgram();
+    glAttachShader(compiled.program, compiled.id);
+    glLinkProgram(compiled.program);
+    
+    GLint isLinked = 0;
+    glGetProgramiv(compiled.program, GL_LINK_STATUS, &isLinked);
+    if (isLinked == GL_FALSE) {
+        GLint maxLength = 0;
+        glGetProgramiv(compiled.program, GL_INFO_LOG_LENGTH, &maxLength);
+
+        // Retrieve and print the error log
+        std::string errorLog(maxLength, ' ');
+        glGetProgramInfoLog(compiled.program, maxLength, &maxLength, &errorLog[0]);
+        std::cout << util::format_error(errorLog, -1, "anvil::renderer_2d::run_shader()", "fatal") << '\n';
+
+        // Clean up
+        glDeleteProgram(compiled.program);
+        glDeleteShader(compiled.id);
+        std::exit(1);
+    }
+
+    // Shaders can be detached and deleted after linking
+    glDetachShader(compiled.program, compiled.id);
+    glDeleteShader(compiled.id);
+
+    compiled_shaders.push_back(compiled);
+    glUseProgram(compiled.program);
+}
+
+void renderer_2d::draw_pixel(anvil::vec2f_t position, anvil::rgba_color color) {
+    glBegin(GL_POINTS);
+    {
+        glColor4f(static_cast<float>(color.x) / 255, static_cast<float>(color.y) / 255, static_cast<float>(color.z) / 255, static_cast<float>(color.a) / 255);
+        glVertex2f(position.x, position.y);
+    }
+    glEnd();
+}
+
+struct __capturebuffer {
+    GLuint pbo;
+    std::size_t capacity = 0;
+
+    // null while the buffer is free
+    GLsync fence = nullptr;
+    uint64_t frame;
+    double time;
+    anvil::vec2i_t size;
+};
+
+struct __framecapture {
+    anvil::capture_callback_t callback;
+    std::vector<__capturebuffer> ring;
+    std::size_t next = 0;
+    std::atomic<uint64_t> dropped { 0 };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<anvil::captured_frame> frames;
+    // pixel vectors handed back by the consumer so steady capture doesn't allocate
+    std::vector<std::vector<uint8_t>> spare;
+    std::size_t max_queued;
+    bool stopping = false;
+    std::thread consumer;
+
+    __framecapture(anvil::capture_callback_t callback, std::size_t ring_size)
+        : callback(std::move(callback)), ring(ring_size), max_queued(ring_size * 2) {
+        consumer = std::thread([this] {
+            while (true) {
+                anvil::captured_frame f;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [this] { return stopping || !frames.empty(); });
+                    if (frames.empty()) {
+                        return;
+                    }
+                    f = std::move(frames.front());
+                    frames.pop_front();
+                }
+
+                // glReadPixels returns the bottom row first
+                std::size_t stride = static_cast<std::size_t>(f.size.x) * 4;
+                for (int y = 0; y < f.size.y / 2; y++) {
+                    std::swap_ranges(f.pixels.begin() + y * stride, f.pixels.begin() + (y + 1) * stride,
+                                     f.pixels.begin() + (f.size.y - y - 1) * stride);
+                }
+                this->callback(f);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (f.pixels.capacity() > 0 && spare.size() < max_queued) {
+                    spare.push_back(std::move(f.pixels));
+                }
+            }
+        });
+    }
+
+    // returns false if the consumer is too far behind
+    bool deliver(const __capturebuffer &b, const uint8_t *pixels) {
+        std::size_t bytes = static_cast<std::size_t>(b.size.x) * b.size.y * 4;
+        anvil::captured_frame f;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (frames.size() >= max_queued) {
+                return false;
+            }
+            if (!spare.empty()) {
+                f.pixels = std::move(spare.back());
+                spare.pop_back();
+            }
+        }
+        f.frame = b.frame;
+        f.time = b.time;
+        f.size = b.size;
+        f.pixels.resize(bytes);
+        std::memcpy(f.pixels.data(), pixels, bytes);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            frames.push_back(std::move(f));
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    // maps a finished buffer and passes its pixels on, wait blocks until the gpu is done
+    bool collect(__capturebuffer &b, bool wait) {
+        GLenum status = glClientWaitSync(b.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return false;
+        }
+        glDeleteSync(b.fence);
+        b.fence = nullptr;
+
+        std::size_t bytes = static_cast<std::size_t>(b.size.x) * b.size.y * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, b.pbo);
+        const uint8_t *pixels = static_cast<const uint8_t *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT));
+        if (pixels) {
+            if (!deliver(b, pixels)) {
+                dropped++;
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            dropped++;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return true;
+    }
+
+    /// @note frames already queued are still delivered
+    ~__framecapture() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        consumer.join();
+    }
+};
+
+void renderer_2d::capture_frame() {
+    __framecapture &c = *capture;
+
+    // hand over every readback the gpu has finished, oldest first
+    for (std::size_t i = 0; i < c.ring.size(); i++) {
+        __capturebuffer &b = c.ring[(c.next + i) % c.ring.size()];
+        // stop at the first unfinished one so frames stay in order
+        if (b.fence && !c.collect(b, false)) {
+            break;
+        }
+    }
+
+    __capturebuffer &b = c.ring[c.next];
+    if (b.fence) {
+        // the gpu is a whole ring behind, waiting would stall the frame
+        c.dropped++;
+        return;
+    }
+
+    anvil::vec2i_t size;
+    glfwGetFramebufferSize(game->glfw_window, &size.x, &size.y);
+    std::size_t bytes = static_cast<std::size_t>(size.x) * size.y * 4;
+    if (bytes == 0) {
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, b.pbo);
+    if (b.capacity < bytes) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        b.capacity = bytes;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_BACK);
+    // with a pack buffer bound this only queues the copy
+    glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    b.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    b.frame = frame_counter;
+    b.time = glfwGetTime();
+    b.size = size;
+    c.next = (c.next + 1) % c.ring.size();
+}
+
+void renderer_2d::start_capture(anvil::capture_callback_t callback, int ring_size) {
+    stop_capture();
+    capture = std::make_unique<__framecapture>(std::move(callback), std::max(ring_size, 2));
+    for (auto &b : capture->ring) {
+        glGenBuffers(1, &b.pbo);
+    }
+}
+
+void renderer_2d::stop_capture() {
+    if (!capture) {
+        return;
+    }
+    for (std::size_t i = 0; i < capture->ring.size(); i++) {
+        __capturebuffer &b = capture->ring[(capture->next + i) % capture->ring.size()];
+        if (b.fence) {
+            capture->collect(b, true);
+        }
+        glDeleteBuffers(1, &b.pbo);
+    }
+    capture.reset();
+}
+
+bool renderer_2d::is_capturing() {
+    return capture != nullptr;
+}
+
+uint64_t renderer_2d::get_dropped_frames() {
+    return capture ? capture->dropped.load() : 0;
+}
+
+renderer_2d::renderer_2d(anvil::game *g) {
+    vsync(true);
+    this->game = g;
+    glinit();
+}
+
+renderer_2d::renderer_2d(anvil::game *g, int fps_) {
+    vsync(false);
+    fps(fps_);
+    this->game = g;
+    glinit();
+}
+
+int renderer_2d::fps() {
+    return target_fps;
+}
+
+uint64_t renderer_2d::get_frame_counter() {
+    return frame_counter;
+}
+
+bool renderer_2d::vsync() {
+    return is_vsync;
+}
+
+double renderer_2d::deltatime() {
+    return delta_time;
+}
+
+int renderer_2d::tri_count() {
+    return triangle_count;
+}
+
+void renderer_2d::glinit() {
+    GLenum err = glewInit();
+    if (err != GLEW_OK) {
+        const GLubyte *err_str = glewGetErrorString(err);
+        const char* errstr = (char*) (err_str); // We have to do C-style string casting :(
+        std::cout << util::format_error(errstr, err, "glew", "fatal");
+        std::exit(1);
+    }
+
+    glViewport(0, 0, game->window_size.x, game->window_size.y);
+    util::gl_setup_ortho(game->window_size);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glEnable(GL_FRAMEBUFFER_SRGB);
+}
+
+void renderer_2d::begin_frame() {
+    start_time = std::chrono::high_resolution_clock::now();
+    frame_start_time = glfwGetTime();
+    delta_time = frame_start_time - last_time;
+    last_time = frame_start_time;
+}
+
+void renderer_2d::clear(anvil::rgba_color color) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClearColor(color.x, color.y, color.z, color.a);
+}
+
+void renderer_2d::draw_rect(anvil::vec2f_t pos, anvil::vec2f_t size, anvil::rgba_color color, float rotation) {
+    glLoadIdentity(); 
+
+    // Rotate the rectangle around the Z-axis (for 2D rotation)
+    glRotatef(rotation, 0.0f, 0.0f, 1.0f); // Rotate around Z-axis
+
+    glBegin(GL_QUADS);
+    {
+        glColor4f((float) color.x / 255, (float) color.y / 255, (float) color.z / 255, (float) color.a / 255);
+        glVertex2f(pos.x, pos.y);
+        glVertex2f(pos.x + size.x, pos.y);
+        glVertex2f(pos.x + size.x, pos.y + size.y);
+        glVertex2f(pos.x, pos.y + size.y);
+    }
+    glEnd();
+
+    util::gl_setup_ortho(game->window_size);
+    triangle_count += 2;
+}
+
+void renderer_2d::draw_circle(anvil::vec2f_t pos, float radius, anvil::rgba_color color, int segments) {
+    glBegin(GL_TRIANGLE_FAN);
+    {
+        glColor4f((float) color.x / 255, (float) color.y / 255, (float) color.z / 255, (float) color.a / 255);
+        for (int i = 0; i <= segments; i++) {
+            float angle = 2 * M_PI * i / segments;
+            glVertex2f(pos.x + radius * cos(angle), pos.y + radius * sin(angle));
+            triangle_count++;
+        }
+    }
+    glEnd();
+}
+
+void renderer_2d::wireframe(bool w) {
+    if (w) {
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    } else {
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    }
+}
+
+void renderer_2d::end_frame() {
+    if (capture) {
+        capture_frame();
+    }
+    glFlush();
+    glfwSwapBuffers(this->game->glfw_window);
+    // counted before the vsync return, captured frames are stamped with it
+    frame_counter++;
+    if (this->is_vsync) {
+        return;
+    }
+    double frametime_limit = 1.0 / target_fps;
+    // SET_PHYSICS_DELTATIME(delta_time);
+
+    double frame_end_time = glfwGetTime();
+    double frame_duration = frame_end_time - frame_start_time;
+
+    auto err = glGetError();
+    if (err != GL_NO_ERROR) {
+        std::cout << util::format_error("unknown", err, "opengl", "fatal") << '\n';
+        game->close();
+        std::exit(1);
+    }
+
+    if (frame_duration < frametime_limit) {
+        double sleep_time = frametime_limit - frame_duration;
+        std::this_thread::sleep_for(std::chrono::duration<double>(sleep_time));
+    }
+}
+
+void renderer_2d::vsync(bool b) {
+    if (b) {
+        glfwSwapInterval(1);
+    } else {
+        glfwSwapInterval(0);
+    }
+    this->is_vsync = b;
+}
+
+void renderer_2d::fps(int fps) {
+    this->target_fps = fps;
+}
+
+void renderer_2d::cleanup() {
+    stop_capture();
+}
+
+renderer_2d::~renderer_2d() {
+    cleanup();
+}
+
+}
+
+namespace anvil {
+
+shader::shader(std::string glsl_code, anvil::shader_type type) : glsl_code(glsl_code), type(type) {}
+
+anvil::memory_usage shader::get_memory_usage() const {
+    return { glsl_code.capacity(), 0 };
+}
+
+audio::audio(std::string path) {
+    std::vector<int16_t> samples;
+    int channels, sample_rate;
+    if (!util::decode_vorbis(path, samples, channels, sample_rate)) {
+        std::exit(1);
+    }
+    upload(samples.data(), samples.size() / channels, channels, sample_rate);
+
+    this->path = path;
+}
+
+audio::audio(const anvil::archive &archive, std::string name) {
+    std::vector<int16_t> samples;
+    int channels, sample_rate;
+
+    std::size_t length;
+    const uint8_t *bytes = archive.view(name, length);
+    std::vector<uint8_t> decompressed;
+    if (!bytes) {
+        if (!archive.read(name, decompressed)) {
+            std::cout << util::format_error("no such entry: " + name, -1, "anvil::audio::audio(archive, ...)", "fatal");
+            std::exit(1);
+        }
+        bytes = decompressed.data();
+        length = decompressed.size();
+    }
+    if (!util::decode_vorbis(bytes, length, samples, channels, sample_rate)) {
+        std::exit(1);
+    }
+    upload(samples.data(), samples.size() / channels, channels, sample_rate);
+}
+
+void audio::upload(const int16_t *samples, std::size_t frames, int channels, int sample_rate) {
+    buffer = new ALuint;
+    alGenBuffers(1, buffer);
+
+    // Determine the OpenAL format
+    ALenum format = (channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+
+    // Fill the OpenAL buffer
+    buffer_bytes = frames * sizeof(int16_t) * channels;
+    duration = static_cast<double>(frames) / sample_rate;
+    alBufferData(*buffer, format, samples, buffer_bytes, sample_rate);
+
+    // Check for OpenAL errors
+    ALenum error = alGetError();
+    if (error != AL_NO_ERROR) {
+        std::cout << util::format_error(alGetString(error), error, "openal", "fatal");
+        std::exit(1);
+    }
+}
+
+void audio::set_audio_context(std::shared_ptr<audio_context> ac) {
+    this->context = ac;
+}
+
+// voice pool
+
+struct __voice {
+    ALuint source;
+    ALuint buffer = 0;
+    uint32_t generation = 1;
+    int priority;
+    uint64_t started;
+    bool busy = false;
+};
+
+struct __voicepool {
+    std::mutex mutex;
+    std::vector<__voice> voices;
+    std::vector<uint32_t> free_voices;
+    std::size_t limit = 32;
+    uint64_t play_counter = 0;
+
+    static __voicepool &get() {
+        static __voicepool pool;
+        return pool;
+    }
+
+    void release(uint32_t index) {
+        __voice &v = voices[index];
+        alSourceStop(v.source);
+        alSourcei(v.source, AL_BUFFER, 0);
+        v.buffer = 0;
+        v.busy = false;
+        // invalidates handles to the finished sound
+        v.generation = v.generation == UINT32_MAX ? 1 : v.generation + 1;
+        free_voices.push_back(index);
+    }
+
+    // recycles every finished voice in one pass instead of checking on each play
+    void poll() {
+        for (uint32_t i = 0; i < voices.size(); i++) {
+            if (!voices[i].busy) {
+                continue;
+            }
+            ALint state = AL_STOPPED;
+            alGetSourcei(voices[i].source, AL_SOURCE_STATE, &state);
+            if (state == AL_STOPPED) {
+                release(i);
+            }
+        }
+    }
+
+    // returns a free voice, growing the pool or stealing one, -1 if there is none for priority
+    int64_t acquire(int priority) {
+        if (free_voices.empty()) {
+            poll();
+        }
+        if (free_voices.empty() && voices.size() < limit) {
+            __voice v;
+            alGetError();
+            alGenSources(1, &v.source);
+            if (alGetError() == AL_NO_ERROR) {
+                voices.push_back(v);
+                return static_cast<int64_t>(voices.size() - 1);
+            }
+            // the implementation ran out of sources
+            limit = voices.size();
+        }
+        if (!free_voices.empty()) {
+            uint32_t index = free_voices.back();
+            free_voices.pop_back();
+            return index;
+        }
+
+        int64_t victim = -1;
+        for (uint32_t i = 0; i < voices.size(); i++) {
+            const __voice &v = voices[i];
+            if (v.priority > priority) {
+                continue;
+            }
+            if (victim < 0 || v.priority < voices[victim].priority
+                    || (v.priority == voices[victim].priority && v.started < voices[victim].started)) {
+                victim = i;
+            }
+        }
+        if (victim >= 0) {
+            release(static_cast<uint32_t>(victim));
+            free_voices.pop_back();
+        }
+        return victim;
+    }
+
+    // returns nullptr for stale handles
+    __voice *find(anvil::voice_handle handle) {
+        if (handle.index >= voices.size()) {
+            return nullptr;
+        }
+        __voice &v = voices[handle.index];
+        return v.busy && v.generation == handle.generation ? &v : nullptr;
+    }
+
+    // stops every voice playing buffer so it can be deleted
+    void release_buffer(ALuint buffer) {
+        for (uint32_t i = 0; i < voices.size(); i++) {
+            if (voices[i].busy && voices[i].buffer == buffer) {
+                release(i);
+            }
+        }
+    }
+
+    // deletes every source, they belong to the audio context that is going away
+    void clear() {
+        for (__voice &v : voices) {
+            alSourceStop(v.source);
+            alSourcei(v.source, AL_BUFFER, 0);
+            alDeleteSources(1, &v.source);
+        }
+        voices.clear();
+        free_voices.clear();
+    }
+};
+
+anvil::voice_handle audio::play(int priority) {
+    ALenum error = alGetError();
+    if (error != AL_NO_ERROR) {
+        std::cout << util::format_error(alGetString(error), error, "openal", "fatal");
+        std::exit(1);
+    }
+
+    __voicepool &pool = __voicepool::get();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    int64_t index = pool.acquire(priority);
+    if (index < 0) {
+        return {};
+    }
+
+    __voice &v = pool.voices[index];
+    v.buffer = *buffer;
+    v.priority = priority;
+    v.started = pool.play_counter++;
+    v.busy = true;
+    alSourcei(v.source, AL_BUFFER, v.buffer);
+    alSourcef(v.source, AL_GAIN, 1.0f);
+    alSourcef(v.source, AL_PITCH, 1.0f);
+    alSourcePlay(v.source);
+    return { static_cast<uint32_t>(index), v.generation };
+}
+
+void audio::stop(anvil::voice_handle voice) {
+    __voicepool &pool = __voicepool::get();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (pool.find(voice)) {
+        pool.release(voice.index);
+    }
+}
+
+bool audio::is_playing(anvil::voice_handle voice) {
+    __voicepool &pool = __voicepool::get();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    __voice *v = pool.find(voice);
+    if (!v) {
+        return false;
+    }
+    ALint state = AL_STOPPED;
+    alGetSourcei(v->source, AL_SOURCE_STATE, &state);
+    return state != AL_STOPPED;
+}
+
+void audio::set_gain(anvil::voice_handle voice, float gain) {
+    __voicepool &pool = __voicepool::get();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (__voice *v = pool.find(voice)) {
+        alSourcef(v->source, AL_GAIN, gain);
+    }
+}
+
+void audio::set_pitch(anvil::voice_handle voice, float pitch) {
+    __voicepool &pool = __voicepool::get();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (__voice *v = pool.find(voice)) {
+        alSourcef(v->source, AL_PITCH, pitch);
+    }
+}
+
+void audio::set_voice_limit(std::size_t limit) {
+    __voicepool &pool = __voicepool::get();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.limit = std::max(limit, pool.voices.size());
+}
+
+anvil::memory_usage audio::get_memory_usage() const {
+    return { buffer ? buffer_bytes : 0, 0 };
+}
+
+double audio::get_duration() const {
+    return duration;
+}
+
+void audio::cleanup() {
+    if (buffer) {
+        {
+            // openal refuses to delete buffers still attached to a source
+            __voicepool &pool = __voicepool::get();
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.release_buffer(*buffer);
+        }
+        alDeleteBuffers(1, buffer);
+        delete buffer;
+        buffer = nullptr;
+    }
+}
+
+audio::~audio() {
+    cleanup();
+}
+
+// software mixer
+
+anvil::memory_usage pcm_buffer::get_memory_usage() const {
+    return { samples.capacity() * sizeof(int16_t), 0 };
+}
+
+pcm_buffer::pcm_buffer(std::string path) {
+    if (!util::decode_vorbis(path, samples, channels, sample_rate)) {
+        std::exit(1);
+    }
+}
+
+pcm_buffer::pcm_buffer(const anvil::archive &archive, std::string name) {
+    std::size_t length;
+    const uint8_t *bytes = archive.view(name, length);
+    std::vector<uint8_t> decompressed;
+    if (!bytes) {
+        if (!archive.read(name, decompressed)) {
+            std::cout << util::format_error("no such entry: " + name, -1, "anvil::pcm_buffer::pcm_buffer(archive, ...)", "fatal");
+            std::exit(1);
+        }
+        bytes = decompressed.data();
+        length = decompressed.size();
+    }
+    if (!util::decode_vorbis(bytes, length, samples, channels, sample_rate)) {
+        std::exit(1);
+    }
+}
+
+// audio scene
+
+audio_scene::audio_scene(std::size_t voice_budget, float gain_threshold) : gain_threshold(gain_threshold) {
+    alDistanceModel(AL_INVERSE_DISTANCE_CLAMPED);
+    alGetError();
+    for (std::size_t i = 0; i < voice_budget; i++) {
+        ALuint source;
+        alGenSources(1, &source);
+        if (alGetError() != AL_NO_ERROR) {
+            std::cout << util::format_error("only " + std::to_string(i) + " sources available", -1, "anvil::audio_scene::audio_scene()", "warning");
+            break;
+        }
+        sources.push_back(source);
+    }
+    source_owner.assign(sources.size(), -1);
+}
+
+void audio_scene::set_listener(anvil::vec3f_t position, anvil::vec3f_t forward, anvil::vec3f_t up) {
+    listener = position;
+    alListener3f(AL_POSITION, position.x, position.y, position.z);
+    ALfloat orientation[6] = { forward.x, forward.y, forward.z, up.x, up.y, up.z };
+    alListenerfv(AL_ORIENTATION, orientation);
+}
+
+void audio_scene::set_listener(anvil::vec2f_t position) {
+    set_listener({ position.x, position.y, 0.0f });
+}
+
+anvil::emitter_handle audio_scene::add_emitter(std::shared_ptr<anvil::audio> sound, std::function<anvil::vec3f_t()> position, anvil::emitter_settings settings) {
+    if (!sound || !sound->buffer || !position) {
+        return {};
+    }
+    uint32_t index;
+    if (!free_emitters.empty()) {
+        index = free_emitters.back();
+        free_emitters.pop_back();
+    } else {
+        index = static_cast<uint32_t>(emitters.size());
+        emitters.emplace_back();
+    }
+    __emitter &e = emitters[index];
+    e.sound = std::move(sound);
+    e.position = std::move(position);
+    e.settings = settings;
+    e.elapsed = 0.0;
+    e.audible_gain = 0.0f;
+    e.source = -1;
+    e.active = true;
+    // picked up as real or virtual on the next update()
+    return { index, e.generation };
+}
+
+__emitter *audio_scene::find(anvil::emitter_handle handle) {
+    if (handle.index >= emitters.size()) {
+        return nullptr;
+    }
+    __emitter &e = emitters[handle.index];
+    return e.active && e.generation == handle.generation ? &e : nullptr;
+}
+
+void audio_scene::make_real(uint32_t index, std::size_t source, anvil::vec3f_t p) {
+    __emitter &e = emitters[index];
+    ALuint s = sources[source];
+    double offset = e.elapsed;
+    if (e.settings.looping && e.sound->duration > 0.0) {
+        offset = std::fmod(offset, e.sound->duration);
+    }
+    alSourcei(s, AL_BUFFER, *e.sound->buffer);
+    alSourcei(s, AL_LOOPING, e.settings.looping ? AL_TRUE : AL_FALSE);
+    alSourcef(s, AL_GAIN, e.settings.gain);
+    alSourcef(s, AL_REFERENCE_DISTANCE, e.settings.reference_distance);
+    alSourcef(s, AL_MAX_DISTANCE, e.settings.max_distance);
+    alSourcef(s, AL_ROLLOFF_FACTOR, e.settings.rolloff);
+    alSource3f(s, AL_POSITION, p.x, p.y, p.z);
+    alSourcef(s, AL_SEC_OFFSET, static_cast<ALfloat>(offset));
+    alSourcePlay(s);
+    e.source = static_cast<int>(source);
+    source_owner[source] = index;
+}
+
+void audio_scene::make_virtual(uint32_t index) {
+    __emitter &e = emitters[index];
+    if (e.source < 0) {
+        return;
+    }
+    ALuint s = sources[e.source];
+    alSourceStop(s);
+    alSourcei(s, AL_BUFFER, 0);
+    source_owner[e.source] = -1;
+    e.source = -1;
+}
+
+void audio_scene::release(uint32_t index) {
+    make_virtual(index);
+    __emitter &e = emitters[index];
+    e.active = false;
+    e.sound.reset();
+    e.position = nullptr;
+    e.generation = e.generation == UINT32_MAX ? 1 : e.generation + 1;
+    free_emitters.push_back(index);
+}
+
+void audio_scene::remove_emitter(anvil::emitter_handle emitter) {
+    if (find(emitter)) {
+        release(emitter.index);
+    }
+}
+
+void audio_scene::set_gain(anvil::emitter_handle emitter, float gain) {
+    if (__emitter *e = find(emitter)) {
+        e->settings.gain = gain;
+        if (e->source >= 0) {
+            alSourcef(sources[e->source], AL_GAIN, gain);
+        }
+    }
+}
+
+bool audio_scene::is_playing(anvil::emitter_handle emitter) {
+    return find(emitter) != nullptr;
+}
+
+bool audio_scene::is_virtual(anvil::emitter_handle emitter) {
+    __emitter *e = find(emitter);
+    return e && e->source < 0;
+}
+
+void audio_scene::update() {
+    auto now = std::chrono::steady_clock::now();
+    double dt = started ? std::chrono::duration<double>(now - last_update).count() : 0.0;
+    last_update = now;
+    started = true;
+
+    // advance playback, attenuate and collect the emitters worth hearing
+    audible.clear();
+    for (uint32_t i = 0; i < emitters.size(); i++) {
+        __emitter &e = emitters[i];
+        if (!e.active) {
+            continue;
+        }
+        if (e.source >= 0) {
+            ALint state = AL_STOPPED;
+            alGetSourcei(sources[e.source], AL_SOURCE_STATE, &state);
+            if (state == AL_STOPPED && !e.settings.looping) {
+                release(i);
+                continue;
+            }
+            ALfloat offset = 0.0f;
+            alGetSourcef(sources[e.source], AL_SEC_OFFSET, &offset);
+            e.elapsed = offset;
+        } else {
+            e.elapsed += dt;
+            if (!e.settings.looping && e.elapsed >= e.sound->duration) {
+                release(i);
+                continue;
+            }
+        }
+
+        anvil::vec3f_t p = e.position();
+        e.last_position = p;
+        float dx = p.x - listener.x, dy = p.y - listener.y, dz = p.z - listener.z;
+        float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        const emitter_settings &s = e.settings;
+        if (distance >= s.max_distance) {
+            e.audible_gain = 0.0f;
+        } else {
+            // same curve as AL_INVERSE_DISTANCE_CLAMPED
+            float d = std::max(distance, s.reference_distance);
+            e.audible_gain = s.gain * s.reference_distance / (s.reference_distance + s.rolloff * (d - s.reference_distance));
+        }
+        if (e.source >= 0) {
+            alSource3f(sources[e.source], AL_POSITION, p.x, p.y, p.z);
+        }
+        if (e.audible_gain >= gain_threshold) {
+            audible.push_back(i);
+        }
+    }
+
+    // the loudest emitters of the highest priority get the sources
+    auto louder = [this](uint32_t a, uint32_t b) {
+        const __emitter &ea = emitters[a], &eb = emitters[b];
+        if (ea.settings.priority != eb.settings.priority) {
+            return ea.settings.priority > eb.settings.priority;
+        }
+        return ea.audible_gain > eb.audible_gain;
+    };
+    if (audible.size() > sources.size()) {
+        std::nth_element(audible.begin(), audible.begin() + sources.size(), audible.end(), louder);
+        audible.resize(sources.size());
+    }
+
+    heard.assign(emitters.size(), false);
+    for (uint32_t i : audible) {
+        heard[i] = true;
+    }
+    for (std::size_t s = 0; s < sources.size(); s++) {
+        if (source_owner[s] >= 0 && !heard[source_owner[s]]) {
+            make_virtual(static_cast<uint32_t>(source_owner[s]));
+        }
+    }
+    std::size_t next_free = 0;
+    for (uint32_t i : audible) {
+        if (emitters[i].source >= 0) {
+            continue;
+        }
+        while (source_owner[next_free] >= 0) {
+            next_free++;
+        }
+        make_real(i, next_free, emitters[i].last_position);
+    }
+}
+
+std::size_t audio_scene::get_real_count() const {
+    return std::count_if(source_owner.begin(), source_owner.end(), [](int64_t owner) { return owner >= 0; });
+}
+
+std::size_t audio_scene::get_virtual_count() const {
+    std::size_t count = 0;
+    for (const auto &e : emitters) {
+        if (e.active && e.source < 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void audio_scene::cleanup() {
+    for (uint32_t i = 0; i < emitters.size(); i++) {
+        if (emitters[i].active) {
+            release(i);
+        }
+    }
+    if (!sources.empty()) {
+        alDeleteSources(static_cast<ALsizei>(sources.size()), sources.data());
+    }
+    sources.clear();
+    source_owner.clear();
+}
+
+audio_scene::~audio_scene() {
+    cleanup();
+}
+
+// pcm cache
+
+std::size_t __pcmentry::bytes() const {
+    return pcm ? pcm->samples.capacity() * sizeof(int16_t) : data->capacity();
+}
+
+pcm_cache::pcm_cache(std::size_t budget, anvil::pcm_format format) : format(format), budget(budget) {}
+
+std::shared_ptr<const anvil::pcm_buffer> pcm_cache::get(const std::string &path) {
+    std::shared_ptr<const std::vector<uint8_t>> data;
+    anvil::pcm_format data_format;
+    int channels;
+    int sample_rate;
+    std::size_t frames;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path);
+        if (it != entries.end()) {
+            __pcmentry &e = it->second;
+            lru.splice(lru.begin(), lru, e.lru);
+            hits++;
+            if (e.pcm) {
+                return e.pcm;
+            }
+            if (std::shared_ptr<const anvil::pcm_buffer> pcm = e.expanded.lock()) {
+                return pcm;
+            }
+            data = e.data;
+            data_format = e.format;
+            channels = e.channels;
+            sample_rate = e.sample_rate;
+            frames = e.frames;
+        } else {
+            misses++;
+        }
+    }
+
+    if (data) {
+        // expand without holding the lock, concurrent hits on the same entry just expand twice
+        std::shared_ptr<anvil::pcm_buffer> pcm = std::make_shared<anvil::pcm_buffer>();
+        pcm->channels = channels;
+        pcm->sample_rate = sample_rate;
+        pcm->samples.resize(frames * channels);
+        if (data_format == anvil::pcm_format::pcm8) {
+            for (std::size_t i = 0; i < pcm->samples.size(); i++) {
+                pcm->samples[i] = static_cast<int16_t>(static_cast<int8_t>((*data)[i]) * 256);
+            }
+        } else {
+            util::adpcm::decode(data->data(), channels, frames, pcm->samples.data());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path);
+        if (it == entries.end() || it->second.data != data) {
+            return pcm;
+        }
+        // keep whichever expansion got there first so every user shares one buffer
+        if (std::shared_ptr<const anvil::pcm_buffer> shared = it->second.expanded.lock()) {
+            return shared;
+        }
+        it->second.expanded = pcm;
+        return pcm;
+    }
+
+    // decode without holding the lock, a concurrent miss on the same path just decodes twice
+    std::shared_ptr<anvil::pcm_buffer> pcm = std::make_shared<anvil::pcm_buffer>();
+    if (!util::decode_vorbis(path, pcm->samples, pcm->channels, pcm->sample_rate)) {
+        return nullptr;
+    }
+
+    __pcmentry e;
+    e.format = format;
+    e.channels = pcm->channels;
+    e.sample_rate = pcm->sample_rate;
+    e.frames = pcm->frames();
+    if (format == anvil::pcm_format::pcm16) {
+        e.pcm = pcm;
+    } else if (format == anvil::pcm_format::pcm8) {
+        std::shared_ptr<std::vector<uint8_t>> compact = std::make_shared<std::vector<uint8_t>>(pcm->samples.size());
+        for (std::size_t i = 0; i < pcm->samples.size(); i++) {
+            // round to nearest, saturating at the top
+            (*compact)[i] = static_cast<uint8_t>(static_cast<int8_t>(std::min(127, (pcm->samples[i] + 128) >> 8)));
+        }
+        e.data = compact;
+        e.expanded = pcm;
+    } else {
+        e.data = std::make_shared<std::vector<uint8_t>>(util::adpcm::encode(pcm->samples.data(), e.channels, e.frames));
+        e.expanded = pcm;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (e.bytes() > budget || entries.count(path)) {
+        return pcm;
+    }
+    lru.push_front(path);
+    e.lru = lru.begin();
+    bytes += e.bytes();
+    entries.emplace(path, std::move(e));
+    evict();
+    return pcm;
+}
+
+void pcm_cache::evict() {
+    while (bytes > budget && !lru.empty()) {
+        auto it = entries.find(lru.back());
+        bytes -= it->second.bytes();
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
+
+bool pcm_cache::contains(const std::string &path) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.count(path) != 0;
+}
+
+void pcm_cache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lru.clear();
+    bytes = 0;
+}
+
+void pcm_cache::set_budget(std::size_t budget) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->budget = budget;
+    evict();
+}
+
+anvil::memory_usage pcm_cache::get_memory_usage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return { bytes, 0 };
+}
+
+uint64_t pcm_cache::get_hits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+uint64_t pcm_cache::get_misses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
+
+struct __mixervoice {
+    std::shared_ptr<const anvil::pcm_buffer> pcm;
+    double position = 0.0;
+    float gain = 1.0f;
+    float pan = 0.0f;
+    float pitch = 1.0f;
+    bool looping = false;
+    uint32_t generation = 0;
+    bool active = false;
+
+    // output frame the voice starts on, 0 for as soon as possible
+    uint64_t start_frame = 0;
+};
+
+struct __mixercommand {
+    enum class kind { play, stop, stop_all, gain, pan, pitch };
+
+    kind type = kind::stop;
+    uint32_t index = 0;
+    uint32_t generation = 0;
+    float value = 0.0f;
+
+    // only for play
+    std::shared_ptr<const anvil::pcm_buffer> pcm;
+    float gain = 1.0f, pan = 0.0f, pitch = 1.0f;
+    bool looping = false;
+    uint64_t start_frame = 0;
+
+    __mixercommand() = default;
+
+    // every command but play
+    __mixercommand(kind type, uint32_t index, uint32_t generation, float value)
+        : type(type), index(index), generation(generation), value(value) {}
+};
+
+struct __mixerstate {
+    static constexpr int buffer_count = 4;
+
+    int sample_rate;
+    int block_frames;
+    ALuint source = 0;
+    ALuint buffers[buffer_count] = {};
+
+    // game threads to the audio thread, producers are serialized by producer_mutex
+    util::spsc_ring<__mixercommand> commands;
+    // indices of finished voices, audio thread back to the game threads
+    util::spsc_ring<uint32_t> finished;
+
+    // owned by the game threads
+    std::mutex producer_mutex;
+    std::vector<uint32_t> free_voices;
+    std::vector<uint32_t> generations;
+
+    // owned by the audio thread
+    std::vector<__mixervoice> voices;
+    std::vector<float> mix;
+    std::vector<float> scratch;
+    std::vector<int16_t> output;
+
+    std::atomic<bool> running { true };
+    std::thread thread;
+
+    std::atomic<int64_t> last_block_us { 0 };
+    std::atomic<int64_t> max_block_us { 0 };
+    std::atomic<uint64_t> blocks { 0 };
+    std::atomic<uint32_t> active_voices { 0 };
+    std::atomic<uint64_t> dropped_commands { 0 };
+    std::atomic<uint64_t> late_starts { 0 };
+
+    // output frames handed to openal, only written by the audio thread
+    std::atomic<uint64_t> frames_mixed { 0 };
+    // output frames openal has played, sampled with the time below
+    std::atomic<uint64_t> frames_played { 0 };
+    std::atomic<int64_t> played_at_ns { 0 };
+    uint64_t frames_unqueued = 0;
+
+    __mixerstate(int sample_rate, int block_frames, std::size_t max_voices)
+        : sample_rate(sample_rate), block_frames(block_frames), commands(1024), finished(max_voices),
+          generations(max_voices, 0), voices(max_voices),
+          mix(static_cast<std::size_t>(block_frames) * 2), scratch(static_cast<std::size_t>(block_frames) * 2),
+          output(static_cast<std::size_t>(block_frames) * 2) {
+        for (std::size_t i = max_voices; i > 0; i--) {
+            free_voices.push_back(static_cast<uint32_t>(i - 1));
+        }
+    }
+
+    // the caller holds producer_mutex
+    bool send(__mixercommand command) {
+        if (!commands.push(std::move(command))) {
+            dropped_commands++;
+            return false;
+        }
+        return true;
+    }
+
+    void finish(uint32_t index) {
+        voices[index].active = false;
+        voices[index].pcm.reset();
+        // can't fail, every index is in flight at most once
+        finished.push(index);
+    }
+
+    void apply(__mixercommand &c) {
+        if (c.type == __mixercommand::kind::stop_all) {
+            for (uint32_t i = 0; i < voices.size(); i++) {
+                if (voices[i].active) {
+                    finish(i);
+                }
+            }
+            return;
+        }
+
+        __mixervoice &v = voices[c.index];
+        if (c.type == __mixercommand::kind::play) {
+            v.pcm = std::move(c.pcm);
+            v.position = 0.0;
+            v.gain = c.gain;
+            v.pan = c.pan;
+            v.pitch = c.pitch;
+            v.looping = c.looping;
+            v.generation = c.generation;
+            v.start_frame = c.start_frame;
+            v.active = true;
+            return;
+        }
+        if (!v.active || v.generation != c.generation) {
+            return;
+        }
+        switch (c.type) {
+            case __mixercommand::kind::stop: finish(c.index); break;
+            case __mixercommand::kind::gain: v.gain = c.value; break;
+            case __mixercommand::kind::pan: v.pan = std::max(-1.0f, std::min(1.0f, c.value)); break;
+            case __mixercommand::kind::pitch: v.pitch = std::max(0.0f, c.value); break;
+            default: break;
+        }
+    }
+
+    // resamples one voice into scratch as stereo from frame first of the block on, returns false once it has ended
+    bool render(__mixervoice &v, int first) {
+        const anvil::pcm_buffer &pcm = *v.pcm;
+        std::size_t frames = pcm.frames();
+        int channels = pcm.channels;
+        double step = static_cast<double>(pcm.sample_rate) / sample_rate * v.pitch;
+        const float scale = 1.0f / 32768.0f;
+
+        std::fill(scratch.begin(), scratch.begin() + first * 2, 0.0f);
+        for (int i = first; i < block_frames; i++) {
+            std::size_t index = static_cast<std::size_t>(v.position);
+            if (index >= frames) {
+                if (!v.looping || frames == 0) {
+                    std::fill(scratch.begin() + i * 2, scratch.end(), 0.0f);
+                    return false;
+                }
+                v.position = std::fmod(v.position, static_cast<double>(frames));
+                index = static_cast<std::size_t>(v.position);
+            }
+            std::size_t next = index + 1 < frames ? index + 1 : (v.looping ? 0 : index);
+            float frac = static_cast<float>(v.position - index);
+
+            const int16_t *a = &pcm.samples[index * channels];
+            const int16_t *b = &pcm.samples[next * channels];
+            float left = (a[0] + (b[0] - a[0]) * frac) * scale;
+            float right = channels > 1 ? (a[1] + (b[1] - a[1]) * frac) * scale : left;
+            scratch[i * 2] = left;
+            scratch[i * 2 + 1] = right;
+            v.position += step;
+        }
+        return true;
+    }
+
+    // mixes one block of every active voice into output
+    void mix_block() {
+        auto start = std::chrono::steady_clock::now();
+
+        __mixercommand command;
+        while (commands.pop(command)) {
+            apply(command);
+        }
+
+        std::fill(mix.begin(), mix.end(), 0.0f);
+        uint32_t active = 0;
+        std::size_t length = mix.size();
+        uint64_t block_start = frames_mixed.load(std::memory_order_relaxed);
+        for (uint32_t index = 0; index < voices.size(); index++) {
+            __mixervoice &v = voices[index];
+            if (!v.active) {
+                continue;
+            }
+
+            // scheduled voices begin on their exact frame inside the block
+            int first = 0;
+            if (v.start_frame >= block_start + block_frames) {
+                continue;
+            } else if (v.start_frame > block_start) {
+                first = static_cast<int>(v.start_frame - block_start);
+            } else if (v.start_frame != 0 && v.start_frame < block_start) {
+                late_starts.fetch_add(1, std::memory_order_relaxed);
+            }
+            v.start_frame = 0;
+
+            active++;
+            bool playing = render(v, first);
+
+            // linear pan law, the centre keeps full gain on both sides
+            float left = v.gain * std::min(1.0f, 1.0f - v.pan);
+            float right = v.gain * std::min(1.0f, 1.0f + v.pan);
+            std::size_t i = 0;
+#if defined(__SSE2__)
+            __m128 gains = _mm_setr_ps(left, right, left, right);
+            for (; i + 4 <= length; i += 4) {
+                __m128 m = _mm_loadu_ps(&mix[i]);
+                _mm_storeu_ps(&mix[i], _mm_add_ps(m, _mm_mul_ps(_mm_loadu_ps(&scratch[i]), gains)));
+            }
+#endif
+            for (; i < length; i += 2) {
+                mix[i] += scratch[i] * left;
+                mix[i + 1] += scratch[i + 1] * right;
+            }
+
+            if (!playing) {
+                finish(index);
+            }
+        }
+
+        std::size_t i = 0;
+#if defined(__SSE2__)
+        const __m128 limit = _mm_set1_ps(32767.0f);
+        for (; i + 4 <= length; i += 4) {
+            __m128 m = _mm_mul_ps(_mm_loadu_ps(&mix[i]), limit);
+            // packs saturate, so no explicit clamp is needed
+            __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(m), _mm_setzero_si128());
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(&output[i]), packed);
+        }
+#endif
+        for (; i < length; i++) {
+            output[i] = static_cast<int16_t>(std::max(-32768.0f, std::min(32767.0f, mix[i] * 32767.0f)));
+        }
+
+        int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        last_block_us.store(elapsed, std::memory_order_relaxed);
+        if (elapsed > max_block_us.load(std::memory_order_relaxed)) {
+            max_block_us.store(elapsed, std::memory_order_relaxed);
+        }
+        active_voices.store(active, std::memory_order_relaxed);
+        blocks.fetch_add(1, std::memory_order_relaxed);
+        frames_mixed.store(block_start + block_frames, std::memory_order_release);
+    }
+
+    // samples the playback position of the source for the audio clock
+    void sample_clock() {
+        ALint offset = 0;
+        alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+        uint64_t played = std::min(frames_unqueued + static_cast<uint64_t>(offset), frames_mixed.load(std::memory_order_relaxed));
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        // readers acquire frames_played, so they see the timestamp that goes with it
+        played_at_ns.store(now, std::memory_order_relaxed);
+        frames_played.store(played, std::memory_order_release);
+    }
+
+    void queue(ALuint buffer) {
+        mix_block();
+        alBufferData(buffer, AL_FORMAT_STEREO16, output.data(), static_cast<ALsizei>(output.size() * sizeof(int16_t)), sample_rate);
+        alSourceQueueBuffers(source, 1, &buffer);
+    }
+
+    void run() {
+        // best effort, needs privileges
+        sched_param param = {};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+        for (ALuint b : buffers) {
+            queue(b);
+        }
+        alSourcePlay(source);
+
+        auto block = std::chrono::microseconds(static_cast<int64_t>(block_frames) * 1000000 / sample_rate);
+        while (running.load(std::memory_order_acquire)) {
+            ALint processed = 0;
+            alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+            while (processed-- > 0) {
+                ALuint b;
+                alSourceUnqueueBuffers(source, 1, &b);
+                frames_unqueued += block_frames;
+                queue(b);
+            }
+            sample_clock();
+
+            ALint state = AL_PLAYING;
+            alGetSourcei(source, AL_SOURCE_STATE, &state);
+            if (state != AL_PLAYING) {
+                // underrun, every queued block has played out
+                alSourcePlay(source);
+            }
+            // a quarter block keeps the clock fine grained and scheduled starts ahead of playback
+            std::this_thread::sleep_for(block / 4);
+        }
+    }
+};
+
+audio_mixer::audio_mixer(int sample_rate, int block_frames, std::size_t max_voices)
+    : state(std::make_unique<__mixerstate>(sample_rate, block_frames, max_voices)) {
+    alGenSources(1, &state->source);
+    alGenBuffers(__mixerstate::buffer_count, state->buffers);
+    ALenum error = alGetError();
+    if (error != AL_NO_ERROR) {
+        std::cout << util::format_error(alGetString(error), error, "openal", "fatal");
+        std::exit(1);
+    }
+    __mixerstate *s = state.get();
+    state->thread = std::thread([s] { s->run(); });
+}
+
+anvil::voice_handle audio_mixer::play(std::shared_ptr<const anvil::pcm_buffer> pcm, float gain, float pan, float pitch, bool looping) {
+    return schedule(std::move(pcm), 0, gain, pan, pitch, looping);
+}
+
+anvil::voice_handle audio_mixer::play_at(double time, std::shared_ptr<const anvil::pcm_buffer> pcm, float gain, float pan, float pitch, bool looping) {
+    // frame 0 means as soon as possible, it has already been played anyway
+    uint64_t frame = std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(std::max(0.0, time) * state->sample_rate)));
+    return schedule(std::move(pcm), frame, gain, pan, pitch, looping);
+}
+
+anvil::voice_handle audio_mixer::schedule(std::shared_ptr<const anvil::pcm_buffer> pcm, uint64_t start_frame, float gain, float pan, float pitch, bool looping) {
+    if (!pcm || pcm->channels < 1 || pcm->channels > 2 || pcm->frames() == 0) {
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock(state->producer_mutex);
+    uint32_t index;
+    while (state->finished.pop(index)) {
+        state->free_voices.push_back(index);
+    }
+    if (state->free_voices.empty()) {
+        return {};
+    }
+    index = state->free_voices.back();
+
+    uint32_t &generation = state->generations[index];
+    generation = generation == UINT32_MAX ? 1 : generation + 1;
+
+    __mixercommand c;
+    c.type = __mixercommand::kind::play;
+    c.index = index;
+    c.generation = generation;
+    c.pcm = std::move(pcm);
+    c.gain = gain;
+    c.pan = std::max(-1.0f, std::min(1.0f, pan));
+    c.pitch = std::max(0.0f, pitch);
+    c.looping = looping;
+    c.start_frame = start_frame;
+    if (!state->send(std::move(c))) {
+        return {};
+    }
+    state->free_voices.pop_back();
+    return { index, generation };
+}
+
+void audio_mixer::stop(anvil::voice_handle voice) {
+    if (!voice.valid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(state->producer_mutex);
+    state->send(__mixercommand(__mixercommand::kind::stop, voice.index, voice.generation, 0.0f));
+}
+
+void audio_mixer::stop_all() {
+    std::lock_guard<std::mutex> lock(state->producer_mutex);
+    state->send(__mixercommand(__mixercommand::kind::stop_all, 0, 0, 0.0f));
+}
+
+void audio_mixer::set_gain(anvil::voice_handle voice, float gain) {
+    if (!voice.valid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(state->producer_mutex);
+    state->send(__mixercommand(__mixercommand::kind::gain, voice.index, voice.generation, gain));
+}
+
+void audio_mixer::set_pan(anvil::voice_handle voice, float pan) {
+    if (!voice.valid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(state->producer_mutex);
+    state->send(__mixercommand(__mixercommand::kind::pan, voice.index, voice.generation, pan));
+}
+
+void audio_mixer::set_pitch(anvil::voice_handle voice, float pitch) {
+    if (!voice.valid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(state->producer_mutex);
+    state->send(__mixercommand(__mixercommand::kind::pitch, voice.index, voice.generation, pitch));
+}
+
+anvil::mixer_stats audio_mixer::get_stats() const {
+    anvil::mixer_stats stats;
+    stats.last_block = std::chrono::microseconds(state->last_block_us.load(std::memory_order_relaxed));
+    stats.max_block = std::chrono::microseconds(state->max_block_us.load(std::memory_order_relaxed));
+    stats.block_duration = std::chrono::microseconds(static_cast<int64_t>(state->block_frames) * 1000000 / state->sample_rate);
+    stats.blocks = state->blocks.load(std::memory_order_relaxed);
+    stats.active_voices = state->active_voices.load(std::memory_order_relaxed);
+    stats.dropped_commands = state->dropped_commands.load(std::memory_order_relaxed);
+    stats.late_starts = state->late_starts.load(std::memory_order_relaxed);
+
+    uint64_t played = state->frames_played.load(std::memory_order_acquire);
+    uint64_t mixed = state->frames_mixed.load(std::memory_order_acquire);
+    stats.queued_frames = mixed > played ? mixed - played : 0;
+    stats.output_latency = std::chrono::microseconds(static_cast<int64_t>(stats.queued_frames) * 1000000 / state->sample_rate);
+    return stats;
+}
+
+double audio_mixer::get_time() const {
+    uint64_t played = state->frames_played.load(std::memory_order_acquire);
+    int64_t at = state->played_at_ns.load(std::memory_order_relaxed);
+    uint64_t mixed = state->frames_mixed.load(std::memory_order_acquire);
+    if (at == 0) {
+        return 0.0;
+    }
+
+    // extrapolate from the last sample, never past what has been mixed
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    double frames = played + (now - at) * 1e-9 * state->sample_rate;
+    return std::min(frames, static_cast<double>(mixed)) / state->sample_rate;
+}
+
+int audio_mixer::get_sample_rate() const {
+    return state->sample_rate;
+}
+
+void audio_mixer::cleanup() {
+    if (!state || !state->thread.joinable()) {
+        return;
+    }
+    state->running.store(false, std::memory_order_release);
+    state->thread.join();
+    alSourceStop(state->source);
+    alSourcei(state->source, AL_BUFFER, 0);
+    alDeleteSources(1, &state->source);
+    alDeleteBuffers(__mixerstate::buffer_count, state->buffers);
+}
+
+audio_mixer::~audio_mixer() {
+    cleanup();
+}
+
+// audio streaming
+
+struct __audiostream {
+    static constexpr int buffer_count = 4;
+    // about 185 ms at 44.1 kHz per buffer
+    static constexpr int buffer_frames = 8192;
+
+    enum class status { stopped, playing, paused };
+
+    std::mutex mutex;
+    stb_vorbis *vorbis = nullptr;
+    // ogg data for streams opened from memory, must outlive vorbis
+    std::vector<uint8_t> memory;
+    ALuint source = 0;
+    ALuint buffers[buffer_count] = {};
+    ALenum format;
+    int channels;
+    int sample_rate;
+    std::vector<int16_t> scratch;
+
+    status state = status::stopped;
+    bool looping = false;
+    // the decoder reached the end, the queued buffers are playing out
+    bool draining = false;
+
+    bool open() {
+        if (!vorbis) {
+            return false;
+        }
+        stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+        channels = info.channels;
+        sample_rate = info.sample_rate;
+        format = channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+        scratch.resize(static_cast<std::size_t>(buffer_frames) * channels);
+        alGenSources(1, &source);
+        alGenBuffers(buffer_count, buffers);
+        return true;
+    }
+
+    // decodes the next chunk into b, returns false at the end of the stream
+    bool fill(ALuint b) {
+        int frames = stb_vorbis_get_samples_short_interleaved(vorbis, channels, scratch.data(), static_cast<int>(scratch.size()));
+        if (frames == 0 && looping) {
+            stb_vorbis_seek_start(vorbis);
+            frames = stb_vorbis_get_samples_short_interleaved(vorbis, channels, scratch.data(), static_cast<int>(scratch.size()));
+        }
+        if (frames == 0) {
+            return false;
+        }
+        alBufferData(b, format, scratch.data(), frames * channels * sizeof(int16_t), sample_rate);
+        return true;
+    }
+
+    // detaches every buffer and rewinds the decoder
+    void rewind() {
+        alSourceStop(source);
+        alSourcei(source, AL_BUFFER, 0);
+        stb_vorbis_seek_start(vorbis);
+        draining = false;
+    }
+
+    void start() {
+        rewind();
+        int queued = 0;
+        while (queued < buffer_count && fill(buffers[queued])) {
+            queued++;
+        }
+        if (queued == 0) {
+            state = status::stopped;
+            return;
+        }
+        draining = queued < buffer_count;
+        alSourceQueueBuffers(source, queued, buffers);
+        alSourcePlay(source);
+        state = status::playing;
+    }
+
+    // refills processed buffers, called from the streaming thread
+    void update() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (state != status::playing) {
+            return;
+        }
+
+        ALint processed = 0;
+        alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+        while (processed-- > 0) {
+            ALuint b;
+            alSourceUnqueueBuffers(source, 1, &b);
+            if (!draining && fill(b)) {
+                alSourceQueueBuffers(source, 1, &b);
+            } else {
+                draining = true;
+            }
+        }
+
+        ALint source_state = AL_STOPPED, queued = 0;
+        alGetSourcei(source, AL_SOURCE_STATE, &source_state);
+        alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
+        if (source_state != AL_PLAYING) {
+            if (queued > 0) {
+                // starved because the thread was late, keep going
+                alSourcePlay(source);
+            } else {
+                state = status::stopped;
+            }
+        }
+    }
+
+    void close() {
+        if (source) {
+            alSourceStop(source);
+            alSourcei(source, AL_BUFFER, 0);
+            alDeleteSources(1, &source);
+            alDeleteBuffers(buffer_count, buffers);
+            source = 0;
+        }
+        if (vorbis) {
+            stb_vorbis_close(vorbis);
+            vorbis = nullptr;
+        }
+        memory.clear();
+        state = status::stopped;
+    }
+};
+
+// one thread refills every playing stream
+struct __audiostreamer {
+    std::vector<std::weak_ptr<__audiostream>> streams;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::thread thread;
+
+    static __audiostreamer &get() {
+        static __audiostreamer streamer;
+        return streamer;
+    }
+
+    void add(std::shared_ptr<__audiostream> stream) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &s : streams) {
+            if (s.lock() == stream) {
+                return;
+            }
+        }
+        streams.push_back(stream);
+        if (!thread.joinable()) {
+            thread = std::thread([this] { run(); });
+        }
+        cv.notify_one();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            if (streams.empty()) {
+                cv.wait(lock, [this] { return stopping || !streams.empty(); });
+                continue;
+            }
+
+            std::vector<std::shared_ptr<__audiostream>> active;
+            for (auto it = streams.begin(); it != streams.end();) {
+                std::shared_ptr<__audiostream> s = it->lock();
+                if (!s) {
+                    it = streams.erase(it);
+                    continue;
+                }
+                active.push_back(std::move(s));
+                it++;
+            }
+
+            lock.unlock();
+            for (auto &s : active) {
+                s->update();
+            }
+            active.clear();
+            lock.lock();
+
+            // a quarter of a buffer, well ahead of an underrun
+            cv.wait_for(lock, std::chrono::milliseconds(40), [this] { return stopping; });
+        }
+    }
+
+    ~__audiostreamer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+};
+
+audio_stream::audio_stream(std::string path) : state(std::make_shared<__audiostream>()) {
+    state->vorbis = stb_vorbis_open_filename(path.c_str(), nullptr, nullptr);
+    if (!state->open()) {
+        std::cout << util::format_error("failed to load file: " + path, -1, "stb_vorbis.h - stb_vorbis_open_filename(...)", "fatal");
         std::exit(1);
     }
+}
 
-    compiled.program = glCreateProgram();
-    glAttachShader(compiled.program, compiled.id);
-    glLinkProgram(compiled.program);
-    
-    GLint isLinked = 0;
-    glGetProgramiv(compiled.program, GL_LINK_STATUS, &isLinked);
-    if (isLinked == GL_FALSE) {
-        GLint maxLength = 0;
-        glGetProgramiv(compiled.program, GL_INFO_LOG_LENGTH, &maxLength);
+audio_stream::audio_stream(const anvil::archive &archive, std::string name) : state(std::make_shared<__audiostream>()) {
+    if (!archive.read(name, state->memory)) {
+        std::cout << util::format_error("no such entry: " + name, -1, "anvil::audio_stream::audio_stream(archive, ...)", "fatal");
+        std::exit(1);
+    }
+    state->vorbis = stb_vorbis_open_memory(state->memory.data(), static_cast<int>(state->memory.size()), nullptr, nullptr);
+    if (!state->open()) {
+        std::cout << util::format_error("failed to load vorbis data", -1, "stb_vorbis.h - stb_vorbis_open_memory(...)", "fatal");
+        std::exit(1);
+    }
+}
 
-        // Retrieve and print the error log
-        std::string errorLog(maxLength, ' ');
-        glGetProgramInfoLog(compiled.program, maxLength, &maxLength, &errorLog[0]);
-        std::cout << util::format_error(errorLog, -1, "anvil::renderer_2d::run_shader()", "fatal") << '\n';
+void audio_stream::play() {
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->vorbis || state->state == __audiostream::status::playing) {
+            return;
+        }
+        if (state->state == __audiostream::status::paused) {
+            alSourcePlay(state->source);
+            state->state = __audiostream::status::playing;
+        } else {
+            state->start();
+        }
+    }
+    __audiostreamer::get().add(state);
+}
 
-        // Clean up
-        glDeleteProgram(compiled.program);
-        glDeleteShader(compiled.id);
+void audio_stream::pause() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->state == __audiostream::status::playing) {
+        alSourcePause(state->source);
+        state->state = __audiostream::status::paused;
+    }
+}
+
+void audio_stream::stop() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->vorbis && state->state != __audiostream::status::stopped) {
+        state->rewind();
+        state->state = __audiostream::status::stopped;
+    }
+}
+
+bool audio_stream::is_playing() const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->state == __audiostream::status::playing;
+}
+
+void audio_stream::set_looping(bool looping) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->looping = looping;
+}
+
+anvil::memory_usage audio_stream::get_memory_usage() const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    std::size_t buffer_bytes = static_cast<std::size_t>(__audiostream::buffer_count) * state->scratch.size() * sizeof(int16_t);
+    return { buffer_bytes + state->scratch.capacity() * sizeof(int16_t) + state->memory.capacity(), 0 };
+}
+
+void audio_stream::cleanup() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->close();
+}
+
+audio_stream::~audio_stream() {
+    cleanup();
+}
+
+// asset_manager::init_audio_context() opens the device and creates the context
+audio_context::audio_context() : device(nullptr), context(nullptr) {}
+
+audio_context::~audio_context() {
+    {
+        __voicepool &pool = __voicepool::get();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.clear();
+    }
+    if (context) {
+        if (alcGetCurrentContext() == context) {
+            alcMakeContextCurrent(nullptr);
+        }
+        alcDestroyContext(context);
+    }
+    if (device) {
+        alcCloseDevice(device);
+    }
+}
+
+void asset_manager::init_audio_context() {
+    this->audio_context = std::make_shared<anvil::audio_context>();
+    audio_context->device = alcOpenDevice(nullptr);
+    if (!audio_context->device) {
+        util::format_error("alcOpenDevice()", alcGetError(audio_context->device), "openal", "fatal");
         std::exit(1);
     }
 
-    // Shaders can be detached and deleted after linking
-    glDetachShader(compiled.program, compiled.id);
-    glDeleteShader(compiled.id);
+    audio_context->context = alcCreateContext(audio_context->device, nullptr);
+    if (!audio_context->context) {
+        std::cout << util::format_error("alcCreateContext()", alcGetError(audio_context->device), "openal", "fatal");
+        std::exit(1);
+    }
+    alcMakeContextCurrent(audio_context->context);
+}
 
-    compiled_shaders.push_back(compiled);
-    glUseProgram(compiled.program);
+asset_manager::asset_manager(std::chrono::seconds t) : timeout(t), lazy_loading(true) {
+    fonts.on_install = [this](uint32_t index, uint32_t generation, std::chrono::high_resolution_clock::time_point last_access) {
+        schedule_expiry(anvil::asset_type::font, index, generation, last_access);
+    };
+    textures.on_install = [this](uint32_t index, uint32_t generation, std::chrono::high_resolution_clock::time_point last_access) {
+        schedule_expiry(anvil::asset_type::texture, index, generation, last_access);
+    };
+    audios.on_install = [this](uint32_t index, uint32_t generation, std::chrono::high_resolution_clock::time_point last_access) {
+        schedule_expiry(anvil::asset_type::audio, index, generation, last_access);
+    };
+
+    route_releases();
+
+    cleanup_thread = std::thread([this]{ run_expiries(); });
 }
 
-void renderer_2d::draw_pixel(anvil::vec2f_t position, anvil::rgba_color color) {
-    glBegin(GL_POINTS);
+void asset_manager::route_releases() {
+    // eviction and expiry run on the cleanup thread or whichever thread called get_*, but the destructors make gl calls
+    fonts.on_release = [this](std::shared_ptr<anvil::font> f) {
+        if (std::this_thread::get_id() != util::gl_thread.load()) {
+            queue_upload([f] {});
+        }
+    };
+    textures.on_release = [this](std::shared_ptr<anvil::texture> t) {
+        if (std::this_thread::get_id() != util::gl_thread.load()) {
+            queue_upload([t] {});
+        }
+    };
+}
+
+void asset_manager::schedule_expiry(anvil::asset_type type, uint32_t index, uint32_t generation, std::chrono::high_resolution_clock::time_point last_access) {
+    std::lock_guard<std::mutex> lock(expiry_mutex);
+    bool earliest = expiries.empty() || last_access + timeout < expiries.top().deadline;
+    expiries.push({ last_access + timeout, type, index, generation });
+    if (earliest) {
+        expiry_cv.notify_one();
+    }
+}
+
+void asset_manager::run_expiries() {
+    std::vector<__expiryentry> due;
+    std::unique_lock<std::mutex> lock(expiry_mutex);
+    while (lazy_loading) {
+        if (expiries.empty()) {
+            expiry_cv.wait(lock);
+            continue;
+        }
+
+        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+        if (expiries.top().deadline > now) {
+            expiry_cv.wait_until(lock, expiries.top().deadline);
+            continue;
+        }
+
+        while (!expiries.empty() && expiries.top().deadline <= now) {
+            due.push_back(expiries.top());
+            expiries.pop();
+        }
+
+        // the tables call schedule_expiry with their lock held, so never hold expiry_mutex while taking theirs
+        lock.unlock();
+        std::chrono::high_resolution_clock::time_point before = now - timeout;
+        for (auto &e : due) {
+            std::chrono::high_resolution_clock::time_point last_access;
+            bool in_use = false;
+            if (e.type == anvil::asset_type::font) {
+                in_use = fonts.expire(e.index, e.generation, before, last_access);
+            } else if (e.type == anvil::asset_type::texture) {
+                in_use = textures.expire(e.index, e.generation, before, last_access);
+            } else if (e.type == anvil::asset_type::audio) {
+                in_use = audios.expire(e.index, e.generation, before, last_access);
+            }
+            if (in_use) {
+                e.deadline = last_access + timeout;
+            } else {
+                e.generation = 0;
+            }
+        }
+        lock.lock();
+
+        for (auto &e : due) {
+            if (e.generation != 0) {
+                expiries.push(e);
+            }
+        }
+        due.clear();
+    }
+}
+
+struct __threadpool {
+    std::vector<std::thread> threads;
+    std::deque<__deferredwork> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    __threadpool(std::size_t count) {
+        for (std::size_t i = 0; i < count; i++) {
+            threads.emplace_back([this] {
+                while (true) {
+                    __deferredwork job;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+                        if (stopping) {
+                            return;
+                        }
+                        job = std::move(jobs.front());
+                        jobs.pop_front();
+                    }
+                    job.run();
+                }
+            });
+        }
+    }
+
+    /// @note cancel runs right away if the pool is already stopped
+    void submit(std::function<void()> job, std::function<void()> cancel) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!stopping) {
+                jobs.push_back({std::move(job), std::move(cancel)});
+                cv.notify_one();
+                return;
+            }
+        }
+        if (cancel) {
+            cancel();
+        }
+    }
+
+    /// @brief joins the threads, jobs that have not started yet get cancelled
+    void stop() {
+        std::deque<__deferredwork> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            dropped.swap(jobs);
+        }
+        cv.notify_all();
+        for (auto &t : threads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+        for (auto &job : dropped) {
+            if (job.cancel) {
+                job.cancel();
+            }
+        }
+    }
+
+    ~__threadpool() {
+        stop();
+    }
+};
+
+std::shared_ptr<__threadpool> asset_manager::get_workers() {
+    std::lock_guard<std::mutex> lock(workers_mutex);
+    if (!workers && !workers_stopped) {
+        // loading is mostly file reads and decoding, leave a core for the render thread
+        std::size_t count = std::max(1u, std::thread::hardware_concurrency() / 2);
+        workers = std::make_shared<__threadpool>(count);
+    }
+    return workers;
+}
+
+void asset_manager::queue_upload(std::function<void()> upload, std::function<void()> cancel) {
     {
-        glColor4f(static_cast<float>(color.x) / 255, static_cast<float>(color.y) / 255, static_cast<float>(color.z) / 255, static_cast<float>(color.a) / 255);
-        glVertex2f(position.x, position.y);
+        std::lock_guard<std::mutex> lock(upload_mutex);
+        // releases still go through process_uploads after cleanup(), they have to run on the gl thread
+        if (!uploads_stopped || !cancel) {
+            uploads.push_back({std::move(upload), std::move(cancel)});
+            return;
+        }
     }
-    glEnd();
+    cancel();
 }
 
-renderer_2d::renderer_2d(anvil::game *g) {
-    vsync(true);
-    this->game = g;
-    glinit();
+std::size_t asset_manager::process_uploads(std::chrono::microseconds budget) {
+    std::chrono::time_point<std::chrono::high_resolution_clock> start = std::chrono::high_resolution_clock::now();
+    while (true) {
+        __deferredwork upload;
+        {
+            std::lock_guard<std::mutex> lock(upload_mutex);
+            if (uploads.empty()) {
+                return 0;
+            }
+            upload = std::move(uploads.front());
+            uploads.pop_front();
+        }
+        upload.run();
+
+        if (std::chrono::high_resolution_clock::now() - start >= budget) {
+            std::lock_guard<std::mutex> lock(upload_mutex);
+            return uploads.size();
+        }
+    }
 }
 
-renderer_2d::renderer_2d(anvil::game *g, int fps_) {
-    vsync(false);
-    fps(fps_);
-    this->game = g;
-    glinit();
+std::future<anvil::texture_handle> asset_manager::load_texture_async(std::string path) {
+    auto promise = std::make_shared<std::promise<anvil::texture_handle>>();
+    std::future<anvil::texture_handle> future = promise->get_future();
+    std::shared_ptr<__threadpool> pool = get_workers();
+    if (!pool) {
+        promise->set_value({});
+        return future;
+    }
+    std::function<void()> cancel = [promise] { promise->set_value({}); };
+    pool->submit([this, path, promise, cancel] {
+        std::shared_ptr<anvil::sprite> s(new anvil::sprite());
+        if (!s->load(path)) {
+            promise->set_value({});
+            return;
+        }
+        queue_upload([this, s, promise] {
+            promise->set_value(add_texture(s->convert_to_texture()));
+        }, cancel);
+    }, cancel);
+    return future;
+}
+
+std::future<anvil::font_handle> asset_manager::load_font_async(std::string path, int font_size) {
+    auto promise = std::make_shared<std::promise<anvil::font_handle>>();
+    std::future<anvil::font_handle> future = promise->get_future();
+    std::shared_ptr<__threadpool> pool = get_workers();
+    if (!pool) {
+        promise->set_value({});
+        return future;
+    }
+    std::function<void()> cancel = [promise] { promise->set_value({}); };
+    pool->submit([this, path, font_size, promise, cancel] {
+        std::shared_ptr<anvil::font> f(new anvil::font());
+        if (!f->load(path, font_size)) {
+            promise->set_value({});
+            return;
+        }
+        queue_upload([this, f, promise] {
+            f->upload();
+            promise->set_value(add_font(f));
+        }, cancel);
+    }, cancel);
+    return future;
+}
+
+std::future<anvil::audio_handle> asset_manager::load_audio_async(std::string path) {
+    auto promise = std::make_shared<std::promise<anvil::audio_handle>>();
+    std::future<anvil::audio_handle> future = promise->get_future();
+    std::shared_ptr<__threadpool> pool = get_workers();
+    if (!pool) {
+        promise->set_value({});
+        return future;
+    }
+    std::function<void()> cancel = [promise] { promise->set_value({}); };
+    pool->submit([this, path, promise, cancel] {
+        std::shared_ptr<const anvil::pcm_buffer> pcm = decode_audio(path);
+        if (!pcm) {
+            promise->set_value({});
+            return;
+        }
+        queue_upload([this, path, pcm, promise] {
+            std::shared_ptr<anvil::audio> a(new anvil::audio());
+            a->upload(pcm->samples.data(), pcm->frames(), pcm->channels, pcm->sample_rate);
+            a->path = path;
+            promise->set_value(add_audio(a));
+        }, cancel);
+    }, cancel);
+    return future;
+}
+
+std::shared_ptr<const anvil::pcm_buffer> asset_manager::decode_audio(const std::string &path) {
+    std::shared_ptr<anvil::pcm_cache> cache = std::atomic_load(&audio_cache);
+    if (cache) {
+        return cache->get(path);
+    }
+    std::shared_ptr<anvil::pcm_buffer> pcm = std::make_shared<anvil::pcm_buffer>();
+    if (!util::decode_vorbis(path, pcm->samples, pcm->channels, pcm->sample_rate)) {
+        return nullptr;
+    }
+    return pcm;
+}
+
+void asset_manager::set_pcm_cache(std::shared_ptr<anvil::pcm_cache> cache) {
+    std::atomic_store(&audio_cache, cache);
+}
+
+std::shared_ptr<anvil::pcm_cache> asset_manager::get_pcm_cache() {
+    return std::atomic_load(&audio_cache);
+}
+
+std::vector<anvil::audio_handle> asset_manager::load_audio_batch(const std::vector<std::string> &paths) {
+    std::vector<std::shared_ptr<const anvil::pcm_buffer>> results(paths.size());
+    std::deque<std::size_t> finished;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    std::shared_ptr<__threadpool> pool = get_workers();
+    if (!pool) {
+        return std::vector<anvil::audio_handle>(paths.size());
+    }
+    for (std::size_t i = 0; i < paths.size(); i++) {
+        auto finish = [&, i] {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.push_back(i);
+            }
+            cv.notify_one();
+        };
+        // the locals outlive the jobs, every job either runs or is cancelled by cleanup() and is waited for below
+        pool->submit([&, i, finish] {
+            results[i] = decode_audio(paths[i]);
+            finish();
+        }, finish);
+    }
+
+    // upload in completion order so openal work overlaps the remaining decodes
+    std::vector<anvil::audio_handle> handles(paths.size());
+    for (std::size_t done = 0; done < paths.size(); done++) {
+        std::size_t i;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return !finished.empty(); });
+            i = finished.front();
+            finished.pop_front();
+        }
+        if (!results[i]) {
+            continue;
+        }
+        const anvil::pcm_buffer &pcm = *results[i];
+        std::shared_ptr<anvil::audio> a(new anvil::audio());
+        a->upload(pcm.samples.data(), pcm.frames(), pcm.channels, pcm.sample_rate);
+        a->path = paths[i];
+        handles[i] = add_audio(a);
+        // drop the pcm right away instead of holding every file until the end
+        results[i].reset();
+    }
+    return handles;
+}
+
+void asset_manager::enforce_memory_budget() {
+    std::size_t budget = memory_budget.load(std::memory_order_relaxed);
+    if (budget == 0 || get_memory_usage().total() <= budget) {
+        return;
+    }
+    uint64_t installs = fonts.installs.load(std::memory_order_relaxed)
+            + textures.installs.load(std::memory_order_relaxed)
+            + audios.installs.load(std::memory_order_relaxed);
+    if (installs == budget_installs.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(budget_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+    // loads racing this pass bump the count again and get their own pass
+    budget_installs.store(installs, std::memory_order_relaxed);
+
+    std::vector<__evictcandidate> candidates;
+    fonts.collect_evictable(anvil::asset_type::font, candidates);
+    textures.collect_evictable(anvil::asset_type::texture, candidates);
+    audios.collect_evictable(anvil::asset_type::audio, candidates);
+
+    std::sort(candidates.begin(), candidates.end(), [](const __evictcandidate &a, const __evictcandidate &b) {
+        return a.last_access < b.last_access;
+    });
+
+    std::size_t usage = get_memory_usage().total();
+    for (auto &c : candidates) {
+        if (usage <= budget) {
+            break;
+        }
+        std::size_t freed = 0;
+        if (c.type == anvil::asset_type::font) {
+            freed = fonts.evict(c.index, c.generation);
+        } else if (c.type == anvil::asset_type::texture) {
+            freed = textures.evict(c.index, c.generation);
+        } else if (c.type == anvil::asset_type::audio) {
+            freed = audios.evict(c.index, c.generation);
+        }
+        usage -= std::min(usage, freed);
+    }
+}
+
+void asset_manager::set_memory_budget(std::size_t bytes) {
+    memory_budget = bytes;
+    budget_installs = UINT64_MAX;
+    enforce_memory_budget();
+}
+
+std::size_t asset_manager::get_memory_budget() const {
+    return memory_budget;
+}
+
+anvil::memory_usage asset_manager::get_memory_usage(anvil::asset_type type) const {
+    switch (type) {
+        case anvil::asset_type::texture: return textures.get_memory_usage();
+        case anvil::asset_type::font:    return fonts.get_memory_usage();
+        case anvil::asset_type::audio:   return audios.get_memory_usage();
+        case anvil::asset_type::shader:  return shaders.get_memory_usage();
+    }
+    return {};
+}
+
+anvil::memory_usage asset_manager::get_memory_usage() const {
+    anvil::memory_usage total;
+    for (anvil::asset_type type : { anvil::asset_type::texture, anvil::asset_type::font, anvil::asset_type::audio }) {
+        anvil::memory_usage usage = get_memory_usage(type);
+        total.cpu_bytes += usage.cpu_bytes;
+        total.gpu_bytes += usage.gpu_bytes;
+    }
+    return total;
+}
+
+std::shared_ptr<texture> asset_manager::reload_texture(anvil::texture_handle handle, const std::string &source, bool compressed, anvil::mipmap_mode mips) {
+    bool on_gl_thread = std::this_thread::get_id() == util::gl_thread.load();
+    // off the gl thread only the first caller decodes, the rest get nullptr until the upload is done
+    if (!on_gl_thread && !textures.claim_reload(handle)) {
+        return nullptr;
+    }
+
+    std::shared_ptr<std::vector<uint8_t>> bytes;
+    std::shared_ptr<anvil::sprite> decoded;
+    bool loaded;
+    if (compressed) {
+        std::size_t length;
+        const uint8_t *mapped = util::map_file(source, length);
+        if (mapped) {
+            bytes = std::make_shared<std::vector<uint8_t>>(mapped, mapped + length);
+            util::unmap_file(mapped, length);
+        } else {
+            std::cout << util::format_error("could not open " + source, -1, "anvil::asset_manager::reload_texture()", "error");
+        }
+        loaded = mapped != nullptr;
+    } else {
+        decoded.reset(new anvil::sprite());
+        loaded = decoded->load(source);
+    }
+    if (!loaded) {
+        if (!on_gl_thread) {
+            textures.restore(handle, nullptr);
+        }
+        return nullptr;
+    }
+
+    auto upload = [handle, source, mips, bytes, decoded]() -> std::shared_ptr<anvil::texture> {
+        std::shared_ptr<anvil::texture> t;
+        if (bytes) {
+            t = std::make_shared<anvil::texture>();
+            if (!t->upload_compressed(bytes->data(), bytes->size(), source)) {
+                return nullptr;
+            }
+            t->source = source;
+        } else {
+            t = decoded->convert_to_texture(mips);
+        }
+        t->handle = handle;
+        return t;
+    };
+    if (on_gl_thread) {
+        return upload();
+    }
+    queue_upload([this, handle, upload] {
+        textures.restore(handle, upload());
+    });
+    return nullptr;
+}
+
+std::shared_ptr<font> asset_manager::reload_font(anvil::font_handle handle, const std::string &path, int size) {
+    bool on_gl_thread = std::this_thread::get_id() == util::gl_thread.load();
+    if (!on_gl_thread && !fonts.claim_reload(handle)) {
+        return nullptr;
+    }
+
+    std::shared_ptr<anvil::font> f(new anvil::font());
+    if (!f->load(path, size)) {
+        if (!on_gl_thread) {
+            fonts.restore(handle, nullptr);
+        }
+        return nullptr;
+    }
+    f->handle = handle;
+    if (on_gl_thread) {
+        f->upload();
+        return f;
+    }
+    queue_upload([this, handle, f] {
+        f->upload();
+        fonts.restore(handle, f);
+    });
+    return nullptr;
+}
+
+std::shared_ptr<audio> asset_manager::get_audio(anvil::audio_handle handle) {
+    std::shared_ptr<audio> a = audios.acquire(handle);
+    enforce_memory_budget();
+    return a;
+}
+
+anvil::audio_handle asset_manager::add_audio(std::shared_ptr<audio> audio) {
+    audio->set_audio_context(this->audio_context);
+    std::function<std::shared_ptr<anvil::audio>(anvil::audio_handle)> reload;
+    if (!audio->path.empty()) {
+        std::string path = audio->path;
+        reload = [this, path](anvil::audio_handle handle) {
+            std::shared_ptr<const anvil::pcm_buffer> pcm = decode_audio(path);
+            if (!pcm) {
+                return std::shared_ptr<anvil::audio>();
+            }
+            std::shared_ptr<anvil::audio> a(new anvil::audio());
+            a->upload(pcm->samples.data(), pcm->frames(), pcm->channels, pcm->sample_rate);
+            a->path = path;
+            a->handle = handle;
+            a->set_audio_context(this->audio_context);
+            return a;
+        };
+    }
+    anvil::audio_handle handle = audios.insert(audio, reload);
+    audio->handle = handle;
+    // drop this copy so an asset the caller does not keep counts as evictable in this pass
+    audio.reset();
+    enforce_memory_budget();
+    return handle;
+}
+
+bool asset_manager::remove_audio(anvil::audio_handle handle) {
+    return audios.remove(handle);
+}
+
+std::shared_ptr<texture> asset_manager::get_texture(anvil::texture_handle handle) {
+    std::shared_ptr<texture> t = textures.acquire(handle);
+    enforce_memory_budget();
+    return t;
+}
+
+anvil::texture_handle asset_manager::add_texture(std::shared_ptr<texture> texture) {
+    std::function<std::shared_ptr<anvil::texture>(anvil::texture_handle)> reload;
+    if (!texture->source.empty()) {
+        std::string source = texture->source;
+        bool compressed = texture->compressed;
+        anvil::mipmap_mode mips = texture->mips;
+        reload = [this, source, compressed, mips](anvil::texture_handle handle) {
+            return reload_texture(handle, source, compressed, mips);
+        };
+    }
+    anvil::texture_handle handle = textures.insert(texture, reload);
+    texture->handle = handle;
+    // drop this copy so an asset the caller does not keep counts as evictable in this pass
+    texture.reset();
+    enforce_memory_budget();
+    return handle;
+}
+
+bool asset_manager::remove_texture(anvil::texture_handle handle) {
+    return textures.remove(handle);
+}
+
+std::shared_ptr<font> asset_manager::get_font(anvil::font_handle handle) {
+    std::shared_ptr<font> f = fonts.acquire(handle);
+    enforce_memory_budget();
+    return f;
+}
+
+anvil::font_handle asset_manager::add_font(std::shared_ptr<font> font) {
+    std::function<std::shared_ptr<anvil::font>(anvil::font_handle)> reload;
+    if (!font->path.empty()) {
+        std::string path = font->path;
+        int size = font->size;
+        reload = [this, path, size](anvil::font_handle handle) {
+            return reload_font(handle, path, size);
+        };
+    }
+    anvil::font_handle handle = fonts.insert(font, reload);
+    font->handle = handle;
+    // drop this copy so an asset the caller does not keep counts as evictable in this pass
+    font.reset();
+    enforce_memory_budget();
+    return handle;
 }
 
-int renderer_2d::fps() {
-    return target_fps;
+bool asset_manager::remove_font(anvil::font_handle handle) {
+    return fonts.remove(handle);
 }
 
-uint64_t renderer_2d::get_frame_counter() {
-    return frame_counter;
+std::shared_ptr<shader> asset_manager::get_shader(anvil::shader_handle handle) {
+    return shaders.acquire(handle);
 }
 
-bool renderer_2d::vsync() {
-    return is_vsync;
+anvil::shader_handle asset_manager::add_shader(std::shared_ptr<shader> shader) {
+    shader->handle = shaders.insert(shader, nullptr);
+    return shader->handle;
 }
 
-double renderer_2d::deltatime() {
-    return delta_time;
+bool asset_manager::remove_shader(anvil::shader_handle handle) {
+    return shaders.remove(handle);
 }
 
-int renderer_2d::tri_count() {
-    return triangle_count;
+asset_manager::asset_manager() : timeout(0), lazy_loading(false) {
+    route_releases();
 }
 
-void renderer_2d::glinit() {
-    GLenum err = glewInit();
-    if (err != GLEW_OK) {
-        const GLubyte *err_str = glewGetErrorString(err);
-        const char* errstr = (char*) (err_str); // We have to do C-style string casting :(
-        std::cout << util::format_error(errstr, err, "glew", "fatal");
-        std::exit(1);
+void asset_manager::cleanup() {
+    // joins the workers, loads that have not started or are waiting for process_uploads fail, later ones fail right away
+    std::shared_ptr<__threadpool> stopping;
+    {
+        std::lock_guard<std::mutex> lock(workers_mutex);
+        workers_stopped = true;
+        stopping = std::move(workers);
+    }
+    if (stopping) {
+        stopping->stop();
+    }
+    std::deque<__deferredwork> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(upload_mutex);
+        uploads_stopped = true;
+        for (auto it = uploads.begin(); it != uploads.end();) {
+            if (it->cancel) {
+                cancelled.push_back(std::move(*it));
+                it = uploads.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+    for (auto &upload : cancelled) {
+        upload.cancel();
+    }
+    {
+        std::lock_guard<std::mutex> lock(expiry_mutex);
+        lazy_loading = false;
+    }
+    expiry_cv.notify_all();
+    if (cleanup_thread.joinable()) {
+        cleanup_thread.join();
     }
+}
 
-    glViewport(0, 0, game->window_size.x, game->window_size.y);
-    util::gl_setup_ortho(game->window_size);
+asset_manager::~asset_manager() {
+    cleanup();
+}
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+// archive
 
-    glEnable(GL_FRAMEBUFFER_SRGB);
+archive::archive(std::string path) {
+    mapping = util::map_file(path, mapping_size);
+    if (!mapping) {
+        std::cout << util::format_error("could not map archive " + path, -1, "anvil::archive::archive()", "fatal");
+        std::exit(1);
+    }
+    if (mapping_size < sizeof(header)) {
+        std::cout << util::format_error("not an archive: " + path, -1, "anvil::archive::archive()", "fatal");
+        std::exit(1);
+    }
+
+    const header *h = reinterpret_cast<const header *>(mapping);
+    bool valid = std::memcmp(h->magic, "ANVILPAK", 8) == 0
+            && h->version == 1
+            && (mapping_size - sizeof(header)) / sizeof(entry) >= h->entry_count
+            && h->names_offset <= mapping_size
+            && h->names_size <= mapping_size - h->names_offset;
+    if (valid) {
+        entries = reinterpret_cast<const entry *>(mapping + sizeof(header));
+        entry_count = h->entry_count;
+        names = reinterpret_cast<const char *>(mapping + h->names_offset);
+
+        // validate once here so lookups don't have to
+        for (uint32_t i = 0; i < entry_count && valid; i++) {
+            const entry &e = entries[i];
+            valid = e.offset <= mapping_size
+                    && e.stored_size <= mapping_size - e.offset
+                    && static_cast<uint64_t>(e.name_offset) + e.name_length <= h->names_size
+                    && (e.compression == anvil::archive_compression::lz4 || e.stored_size == e.size);
+        }
+    }
+    if (!valid) {
+        std::cout << util::format_error("corrupt archive " + path, -1, "anvil::archive::archive()", "fatal");
+        std::exit(1);
+    }
 }
 
-void renderer_2d::begin_frame() {
-    start_time = std::chrono::high_resolution_clock::now();
-    frame_start_time = glfwGetTime();
-    delta_time = frame_start_time - last_time;
-    last_time = frame_start_time;
+archive::~archive() {
+    if (mapping) {
+        util::unmap_file(mapping, mapping_size);
+    }
 }
 
-void renderer_2d::clear(anvil::rgba_color color) {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glClearColor(color.x, color.y, color.z, color.a);
+const archive::entry *archive::find(const std::string &name) const {
+    uint64_t hash = util::fnv1a64(name.data(), name.size());
+    const entry *end = entries + entry_count;
+    const entry *it = std::lower_bound(entries, end, hash, [](const entry &e, uint64_t h) { return e.name_hash < h; });
+    // hashes can collide, the table is sorted by name within the same hash
+    for (; it != end && it->name_hash == hash; it++) {
+        if (it->name_length == name.size() && std::memcmp(names + it->name_offset, name.data(), name.size()) == 0) {
+            return it;
+        }
+    }
+    return nullptr;
 }
 
-void renderer_2d::draw_rect(anvil::vec2f_t pos, anvil::vec2f_t size, anvil::rgba_color color, float rotation) {
-    glLoadIdentity(); 
+bool archive::contains(const std::string &name) const {
+    return find(name) != nullptr;
+}
 
-    // Rotate the rectangle around the Z-axis (for 2D rotation)
-    glRotatef(rotation, 0.0f, 0.0f, 1.0f); // Rotate around Z-axis
+std::size_t archive::size_of(const std::string &name) const {
+    const entry *e = find(name);
+    return e ? e->size : 0;
+}
 
-    glBegin(GL_QUADS);
-    {
-        glColor4f((float) color.x / 255, (float) color.y / 255, (float) color.z / 255, (float) color.a / 255);
-        glVertex2f(pos.x, pos.y);
-        glVertex2f(pos.x + size.x, pos.y);
-        glVertex2f(pos.x + size.x, pos.y + size.y);
-        glVertex2f(pos.x, pos.y + size.y);
+const uint8_t *archive::view(const std::string &name, std::size_t &size) const {
+    const entry *e = find(name);
+    if (!e || e->compression != anvil::archive_compression::none) {
+        return nullptr;
     }
-    glEnd();
-
-    util::gl_setup_ortho(game->window_size);
-    triangle_count += 2;
+    size = e->size;
+    return mapping + e->offset;
 }
 
-void renderer_2d::draw_circle(anvil::vec2f_t pos, float radius, anvil::rgba_color color, int segments) {
-    glBegin(GL_TRIANGLE_FAN);
-    {
-        glColor4f((float) color.x / 255, (float) color.y / 255, (float) color.z / 255, (float) color.a / 255);
-        for (int i = 0; i <= segments; i++) {
-            float angle = 2 * M_PI * i / segments;
-            glVertex2f(pos.x + radius * cos(angle), pos.y + radius * sin(angle));
-            triangle_count++;
-        }
+bool archive::read(const std::string &name, std::vector<uint8_t> &out) const {
+    const entry *e = find(name);
+    if (!e) {
+        return false;
     }
-    glEnd();
+    out.resize(e->size);
+    if (e->compression == anvil::archive_compression::none) {
+        std::memcpy(out.data(), mapping + e->offset, e->size);
+        return true;
+    }
+    return util::lz4::decompress(mapping + e->offset, e->stored_size, out.data(), out.size());
 }
 
-void renderer_2d::wireframe(bool w) {
-    if (w) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    } else {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+std::vector<std::string> archive::list() const {
+    std::vector<std::string> result;
+    result.reserve(entry_count);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        result.emplace_back(names + entries[i].name_offset, entries[i].name_length);
     }
+    return result;
 }
 
-void renderer_2d::end_frame() {
-    glFlush();
-    glfwSwapBuffers(this->game->glfw_window);
-    if (this->is_vsync) {
-        return;
+bool archive::pack(const std::vector<std::pair<std::string, std::string>> &files, const std::string &output, bool compress) {
+    struct pending {
+        std::string name;
+        entry e;
+        std::vector<uint8_t> blob;
+    };
+
+    std::vector<pending> items;
+    items.reserve(files.size());
+    for (auto &[name, path] : files) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cout << util::format_error("could not read " + path, -1, "anvil::archive::pack()", "error");
+            return false;
+        }
+        std::vector<uint8_t> raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        pending p;
+        p.name = name;
+        p.e = {};
+        p.e.name_hash = util::fnv1a64(name.data(), name.size());
+        p.e.size = raw.size();
+        p.e.compression = anvil::archive_compression::none;
+        if (compress && !raw.empty()) {
+            std::vector<uint8_t> packed = util::lz4::compress(raw.data(), raw.size());
+            if (packed.size() < raw.size()) {
+                p.e.compression = anvil::archive_compression::lz4;
+                raw = std::move(packed);
+            }
+        }
+        p.e.stored_size = raw.size();
+        p.blob = std::move(raw);
+        items.push_back(std::move(p));
     }
-    double frametime_limit = 1.0 / target_fps;
-    // SET_PHYSICS_DELTATIME(delta_time);
-    
-    frame_counter++;
 
-    double frame_end_time = glfwGetTime();
-    double frame_duration = frame_end_time - frame_start_time;
+    std::sort(items.begin(), items.end(), [](const pending &a, const pending &b) {
+        return a.e.name_hash != b.e.name_hash ? a.e.name_hash < b.e.name_hash : a.name < b.name;
+    });
 
-    auto err = glGetError();
-    if (err != GL_NO_ERROR) {
-        std::cout << util::format_error("unknown", err, "opengl", "fatal") << '\n';
-        game->close();
-        std::exit(1);
+    std::string name_blob;
+    for (auto &p : items) {
+        p.e.name_offset = static_cast<uint32_t>(name_blob.size());
+        p.e.name_length = static_cast<uint32_t>(p.name.size());
+        name_blob += p.name;
     }
 
-    if (frame_duration < frametime_limit) {
-        double sleep_time = frametime_limit - frame_duration;
-        std::this_thread::sleep_for(std::chrono::duration<double>(sleep_time));
+    auto align16 = [](uint64_t v) { return (v + 15) & ~uint64_t(15); };
+
+    header h = {};
+    std::memcpy(h.magic, "ANVILPAK", 8);
+    h.version = 1;
+    h.entry_count = static_cast<uint32_t>(items.size());
+    h.names_offset = sizeof(header) + items.size() * sizeof(entry);
+    h.names_size = name_blob.size();
+
+    uint64_t offset = align16(h.names_offset + h.names_size);
+    for (auto &p : items) {
+        p.e.offset = offset;
+        offset = align16(offset + p.e.stored_size);
     }
-}
 
-void renderer_2d::vsync(bool b) {
-    if (b) {
-        glfwSwapInterval(1);
-    } else {
-        glfwSwapInterval(0);
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cout << util::format_error("could not write " + output, -1, "anvil::archive::pack()", "error");
+        return false;
     }
-    this->is_vsync = b;
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    for (auto &p : items) {
+        out.write(reinterpret_cast<const char *>(&p.e), sizeof(p.e));
+    }
+    out.write(name_blob.data(), name_blob.size());
+
+    uint64_t written = h.names_offset + h.names_size;
+    static const char padding[16] = {};
+    for (auto &p : items) {
+        out.write(padding, p.e.offset - written);
+        out.write(reinterpret_cast<const char *>(p.blob.data()), p.blob.size());
+        written = p.e.offset + p.e.stored_size;
+    }
+    return static_cast<bool>(out);
 }
 
-void renderer_2d::fps(int fps) {
-    this->target_fps = fps;
+// font
+
+font::font(std::string filepath, int font_size) {
+    if (!load(filepath, font_size)) {
+        std::exit(1);
+    }
+    upload();
 }
 
-void renderer_2d::cleanup() {}
+bool font::load(const std::string &filepath, int font_size) {
+    FILE *f = fopen(filepath.c_str(), "rb");
+    if (!f) {
+        std::cout << util::format_error("could not open font file", -1, "fopen() - stdio.h", "error");
+        return false;
+    }
 
-renderer_2d::~renderer_2d() {
-    cleanup();
-}
+    fread(ttf_buffer, 1, 1 << 20, f);
+    fclose(f);
 
+    this->path = filepath;
+    return bake(font_size);
 }
 
-namespace anvil {
+font::font(const anvil::archive &archive, std::string name, int font_size) {
+    std::size_t length;
+    const uint8_t *bytes = archive.view(name, length);
+    std::vector<uint8_t> decompressed;
+    if (!bytes) {
+        if (!archive.read(name, decompressed)) {
+            std::cout << util::format_error("no such entry: " + name, -1, "anvil::font::font(archive, ...)", "fatal");
+            std::exit(1);
+        }
+        bytes = decompressed.data();
+        length = decompressed.size();
+    }
+    // same limit as reading from a file
+    std::memcpy(ttf_buffer, bytes, std::min<std::size_t>(length, 1 << 20));
 
-shader::shader(std::string glsl_code, anvil::shader_type type) : glsl_code(glsl_code), type(type) {}
+    if (!bake(font_size)) {
+        std::exit(1);
+    }
+    upload();
+}
 
-audio::audio(std::string path) {
-    alGenBuffers(1, buffer);
+bool font::bake(int font_size) {
+    this->size = font_size;
 
-    // Variables to hold audio data
-    int channels, sampleRate;
-    short* output;
-    int samples;
+    if (stbtt_BakeFontBitmap(ttf_buffer, 0, static_cast<float>(font_size), temp_bitmap, 512, 512, 32, 96, cdata) <= 0) {
+        std::cout << util::format_error("could not bake font bitmap", -1, "stbtt_BakeFontBitmap() - stb_truetype.h", "warning");
+    }
 
-    // Decode the Vorbis file
-    stb_vorbis* vorbis = stb_vorbis_open_filename(path.c_str(), nullptr, nullptr);
-    if (!vorbis) {
-        std::cout << util::format_error("failed to load vorbis file", -1, "stb_vorbis.h - stb_vorbis_open_filename(...)", "fatal");
-        std::exit(1);
+    if (!stbtt_InitFont(&info, ttf_buffer, stbtt_GetFontOffsetForIndex(ttf_buffer, 0))) {
+        std::cout << util::format_error("could not read font metrics", -1, "stbtt_InitFont() - stb_truetype.h", "error");
+        return false;
     }
 
-    // Get the format info
-    stb_vorbis_info info = stb_vorbis_get_info(vorbis);
-    channels = info.channels; // Get channel count
-    sampleRate = info.sample_rate; // Get sample rate
+    // same scale stbtt_BakeFontBitmap uses, so kerning matches the baked advances
+    scale = stbtt_ScaleForPixelHeight(&info, static_cast<float>(font_size));
 
-    // Calculate total samples
-    samples = stb_vorbis_stream_length_in_samples(vorbis);
-    output = new short[samples * channels]; // Allocate for stereo or mono
+    int asc, desc, gap;
+    stbtt_GetFontVMetrics(&info, &asc, &desc, &gap);
+    ascent = asc * scale;
+    descent = desc * scale;
+    line_gap = gap * scale;
+    return true;
+}
 
-    // Decode the audio data
-    int numSamples = stb_vorbis_get_samples_short_interleaved(vorbis, channels, output, samples * channels);
-    stb_vorbis_close(vorbis);
+void font::upload() {
+    glGenTextures(1, &tid);
+    glBindTexture(GL_TEXTURE_2D, tid);
 
-    // Determine the OpenAL format
-    ALenum format = (channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 512, 512, 0, GL_ALPHA, GL_UNSIGNED_BYTE, temp_bitmap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
 
-    // Fill the OpenAL buffer
-    alBufferData(*buffer, format, output, numSamples * sizeof(short) * channels, sampleRate);
+uint64_t font::next_serial() {
+    static std::atomic<uint64_t> serial{ 0 };
+    return ++serial;
+}
 
-    // Check for OpenAL errors
-    ALenum error = alGetError();
-    if (error != AL_NO_ERROR) {
-        std::cout << util::format_error(alGetString(error), error, "openal", "fatal");
-        std::exit(1);
+font::~font() {
+    if (tid) {
+        glDeleteTextures(1, &tid);
     }
-
-    this->path = path;
+    delete[] ttf_buffer;
+    delete[] temp_bitmap;
+    delete[] cdata;
 }
 
-void audio::set_audio_context(std::shared_ptr<audio_context> ac) {
-    this->context = ac;
+float font::get_kerning(int codepoint, int next) const {
+    if (codepoint < 32 || codepoint > 126 || next < 32 || next > 126) {
+        return 0;
+    }
+    return scale * stbtt_GetCodepointKernAdvance(&info, codepoint, next);
 }
 
-void audio::play() {
-    ALenum error = alGetError();
-    if (error != AL_NO_ERROR) {
-        std::cout << util::format_error(alGetString(error), error, "openal", "fatal");
-        std::exit(1);
+float font::get_advance(int codepoint, int next) const {
+    if (codepoint < 32 || codepoint > 126) {
+        return 0;
     }
-    alSourcePlay(*buffer);
-    ALuint source;
-    alGenSources(1, &source);
-    alSourcei(source, AL_BUFFER, *buffer);
-    alSourcePlay(source);
+    return cdata[codepoint - 32].xadvance + get_kerning(codepoint, next);
 }
 
-void audio::cleanup() {
-    if (buffer) {
-        alDeleteBuffers(1, buffer);
-        delete buffer;
-        buffer = nullptr;
-    }
+anvil::memory_usage font::get_memory_usage() const {
+    anvil::memory_usage usage;
+    usage.cpu_bytes = (1 << 20) + 512 * 512 + 96 * sizeof(stbtt_bakedchar) + sizeof(stbtt_fontinfo);
+    usage.gpu_bytes = 512 * 512; // GL_ALPHA glyph atlas
+    return usage;
 }
 
-audio::~audio() {
-    cleanup();
+float font::get_line_height() const {
+    return ascent - descent + line_gap;
 }
 
-audio_context::audio_context() {
-    this->device = alcOpenDevice(nullptr);
+float font::get_ascent() const {
+    return ascent;
 }
 
-void asset_manager::init_audio_context() {
-    this->audio_context = std::make_shared<anvil::audio_context>();
-    audio_context->device = alcOpenDevice(nullptr);
-    if (!audio_context->device) {
-        util::format_error("alcOpenDevice()", alcGetError(audio_context->device), "openal", "fatal");
-        std::exit(1);
-    }
+int font::get_size() const {
+    return size;
+}
 
-    audio_context->context = alcCreateContext(audio_context->device, nullptr);
-    if (!audio_context->context) {
-        std::cout << util::format_error("alcCreateContext()", alcGetError(audio_context->device), "openal", "fatal");
-        std::exit(1);
+float font::measure(const std::string &text) const {
+    float width = 0;
+    for (std::size_t i = 0; i < text.size(); i++) {
+        int next = i + 1 < text.size() ? static_cast<unsigned char>(text[i + 1]) : 0;
+        width += get_advance(static_cast<unsigned char>(text[i]), next);
     }
-    alcMakeContextCurrent(audio_context->context);
+    return width;
 }
 
-asset_manager::asset_manager(std::chrono::seconds t) : timeout(t), lazy_loading(true) {
-    cleanup_thread = std::thread([this]{
-        while (lazy_loading) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            std::chrono::time_point<std::chrono::high_resolution_clock> now = std::chrono::high_resolution_clock::now();
-
-            std::vector<std::shared_ptr<audio>> audio_removes;
-            std::vector<std::shared_ptr<font>> font_removes;
-            std::vector<std::shared_ptr<texture>> texture_removes;
-
-            std::lock_guard<std::mutex> x(asset_mutex);
-            for (auto &[k, v] : fonts) {
-                if (std::chrono::high_resolution_clock::to_time_t(now) - std::chrono::high_resolution_clock::to_time_t(v) > timeout.count()) {
-                    font_removes.push_back(k);
-                }
-            }
+// text layout
 
-            for (auto &[k, v] : textures) {
-                if (std::chrono::high_resolution_clock::to_time_t(now) - std::chrono::high_resolution_clock::to_time_t(v) > timeout.count()) {
-                    texture_removes.push_back(k);
-                }
-            }
+text_layout_engine::text_layout_engine(std::size_t capacity) : capacity(capacity) {}
 
-            for (auto &[k, v] : audios) {
-                if (std::chrono::high_resolution_clock::to_time_t(now) - std::chrono::high_resolution_clock::to_time_t(v) > timeout.count()) {
-                    audio_removes.push_back(k);
-                }
-            }
+bool text_layout_engine::cache_key::operator==(const cache_key &other) const {
+    return font == other.font && max_width == other.max_width && align == other.align && text == other.text;
+}
+
+std::size_t text_layout_engine::cache_key_hash::operator()(const cache_key &key) const {
+    std::size_t h = std::hash<std::string>{}(key.text);
+    h ^= std::hash<uint64_t>{}(key.font) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= std::hash<float>{}(key.max_width) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= static_cast<std::size_t>(key.align) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+}
+
+std::shared_ptr<const text_layout> text_layout_engine::build(const anvil::font &font, const std::string &text, float max_width, anvil::text_align align) {
+    // kerning of a + b = width(a) + kerning(last of a, first of b) + width(b)
+    // so lines can be grown a word at a time without measuring them again
+    auto join_width = [&font](const std::string &a, float a_width, const std::string &b, float b_width) {
+        if (a.empty()) {
+            return b_width;
+        }
+        if (b.empty()) {
+            return a_width;
+        }
+        return a_width + font.get_kerning(static_cast<unsigned char>(a.back()), static_cast<unsigned char>(b.front())) + b_width;
+    };
+
+    std::vector<std::pair<std::string, float>> lines;
+    bool wrap = max_width > 0;
 
-            for (auto v : font_removes) {
-                fonts.erase(v);
-                audios_removed.insert({v->path, v->id});
-                v.reset();
+    std::size_t paragraph_start = 0;
+    while (paragraph_start <= text.size()) {
+        std::size_t paragraph_end = text.find('\n', paragraph_start);
+        if (paragraph_end == std::string::npos) {
+            paragraph_end = text.size();
+        }
+
+        std::string line;
+        float line_width = 0;
+        bool line_started = false;
+
+        std::size_t word_start = paragraph_start;
+        while (word_start <= paragraph_end) {
+            std::size_t word_end = text.find(' ', word_start);
+            if (word_end == std::string::npos || word_end > paragraph_end) {
+                word_end = paragraph_end;
+            }
+            std::string word = text.substr(word_start, word_end - word_start);
+            float word_width = font.measure(word);
+
+            std::string candidate = word;
+            float candidate_width = word_width;
+            if (line_started) {
+                std::string spaced = line + ' ';
+                float spaced_width = join_width(line, line_width, " ", font.get_advance(' ', 0));
+                candidate = spaced + word;
+                candidate_width = join_width(spaced, spaced_width, word, word_width);
             }
 
-            for (auto v : texture_removes) {
-                textures.erase(v);
-                v.reset();
+            if (!wrap || candidate_width <= max_width || !line_started) {
+                line = std::move(candidate);
+                line_width = candidate_width;
+                line_started = true;
+            } else {
+                lines.push_back({ line, line_width });
+                line = word;
+                line_width = word_width;
             }
 
-            for (auto v : audio_removes) {
-                audios.erase(v);
-                audios_removed.insert({v->path, v->id});
-                v.reset();
+            // break words that do not fit on a line of their own between characters
+            while (wrap && line_width > max_width && line.size() > 1) {
+                std::size_t fit = 0;
+                float fit_width = 0;
+                for (std::size_t i = 0; i < line.size(); i++) {
+                    float next_width = fit_width + font.get_advance(static_cast<unsigned char>(line[i]), 0);
+                    if (next_width > max_width && i > 0) {
+                        break;
+                    }
+                    fit_width = next_width + (i + 1 < line.size() ? font.get_kerning(static_cast<unsigned char>(line[i]), static_cast<unsigned char>(line[i + 1])) : 0);
+                    fit = i + 1;
+                }
+                if (fit >= line.size()) {
+                    break;
+                }
+                std::string head = line.substr(0, fit);
+                lines.push_back({ head, font.measure(head) });
+                line = line.substr(fit);
+                line_width = font.measure(line);
             }
+
+            word_start = word_end + 1;
         }
-    });
-    cleanup_thread.detach();
-}
-
-std::shared_ptr<audio> asset_manager::get_audio(int id) {
-    asset_mutex.lock();
-    for (auto &[k, v] : audios) {
-        if (k->id == id) {
-            v = std::chrono::high_resolution_clock::now();
-            asset_mutex.unlock();
-            return k;
-        }
-    }
-    std::string path;
-    int removed_id;
-    bool found = false;
-    for (auto &[k, v] : audios_removed) {
-        if (v == id) {
-            path = k;
-            removed_id = v;
-            found = true;
-            break;
-        }
-    }
-    if (!found) {
-        return nullptr;
-    }
-    int prev_audio_id = audio_id;
-    audio_id = removed_id;
 
-    std::shared_ptr<audio> a = std::make_shared<audio>(path);
-    add_audio(a);
-    audio_id = prev_audio_id;
-    asset_mutex.unlock();
-    return a;
-}
+        lines.push_back({ line, line_width });
+        paragraph_start = paragraph_end + 1;
+    }
 
-int asset_manager::add_audio(std::shared_ptr<audio> audio) {
-    asset_mutex.lock();
-    audio->id = audio_id++; // use the current one and increment
-    audio->set_audio_context(this->audio_context);
-    audios[audio] = std::chrono::high_resolution_clock::now();
-    asset_mutex.unlock();
-    return audio->id;
-}
+    auto layout = std::make_shared<anvil::text_layout>();
+    layout->line_height = font.get_line_height();
 
-std::shared_ptr<texture> asset_manager::get_texture(int id) {
-    asset_mutex.lock();
-    for (auto &[k, v] : textures) {
-        if (k->id == id) {
-            v = std::chrono::high_resolution_clock::now();
-            asset_mutex.unlock();
-            return k;
-        }
+    float widest = 0;
+    for (auto &[line, width] : lines) {
+        widest = std::max(widest, width);
     }
-    return nullptr;
-}
+    float box_width = wrap ? max_width : widest;
+
+    float baseline = font.get_ascent();
+    for (auto &[line, width] : lines) {
+        float x = 0;
+        if (align == anvil::text_align::center) {
+            x = (box_width - width) / 2;
+        } else if (align == anvil::text_align::right) {
+            x = box_width - width;
+        }
 
-int asset_manager::add_texture(std::shared_ptr<texture> texture) {
-    asset_mutex.lock();
-    texture->id = texture_id++; // use the current one and increment
-    textures[texture] = std::chrono::high_resolution_clock::now();
-    asset_mutex.unlock();
-    return texture->id;
-}
-
-std::shared_ptr<font> asset_manager::get_font(int id) {
-    asset_mutex.lock();
-    for (auto &[k, v] : fonts) {
-        if (k->id == id) {
-            v = std::chrono::high_resolution_clock::now();
-            asset_mutex.unlock();
-            return k;
-        }
-    }
-    std::string path;
-    int removed_id;
-    int font_size;
-    bool found = false;
-    for (auto &[k, v] : fonts_removed) {
-        if (std::get<0>(v) == id) {
-            path = k;
-            removed_id = std::get<0>(v);
-            font_size = std::get<1>(v);
-            found = true;
-            break;
+        anvil::text_line l;
+        l.first_glyph = layout->glyphs.size();
+        l.glyph_count = line.size();
+        l.width = width;
+        for (std::size_t i = 0; i < line.size(); i++) {
+            int c = static_cast<unsigned char>(line[i]);
+            int next = i + 1 < line.size() ? static_cast<unsigned char>(line[i + 1]) : 0;
+            layout->glyphs.push_back({ c, { x, baseline } });
+            x += font.get_advance(c, next);
         }
+        layout->lines.push_back(l);
+        baseline += layout->line_height;
     }
-    if (!found) {
-        return nullptr;
-    }
-    int prev_font_id = font_id;
-    font_id = removed_id;
 
-    std::shared_ptr<font> f = std::make_shared<font>(path, font_size);
-    add_font(f);
-    font_id = prev_font_id;
-    asset_mutex.unlock();
-    return f;
+    layout->size = { widest, layout->line_height * lines.size() };
+    return layout;
 }
 
-int asset_manager::add_font(std::shared_ptr<font> font) {
-    asset_mutex.lock();
-    font->id = font_id++; // use the current one and increment
-    fonts[font] = std::chrono::high_resolution_clock::now();
-    asset_mutex.unlock();
-    return font->id;
-}
+std::shared_ptr<const text_layout> text_layout_engine::layout(const anvil::font &font, const std::string &text, float max_width, anvil::text_align align) {
+    cache_key key{ font.serial, text, max_width > 0 ? max_width : 0, align };
 
-std::shared_ptr<shader> asset_manager::get_shader(int id) {
-    asset_mutex.lock();
-    for (auto &k : shaders) {
-        if (k->id == id) {
-            asset_mutex.unlock();
-            return k;
-        }
+    auto it = lookup.find(key);
+    if (it != lookup.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        hits++;
+        return it->second->second;
     }
-    return nullptr;
-}
-
-int asset_manager::add_shader(std::shared_ptr<shader> shader) {
-    asset_mutex.lock();
-    shader->id = shader_id++; // use the current one and increment
-    shaders.push_back(shader);
-    asset_mutex.unlock();
-    return shader->id;
-}
+    misses++;
 
-asset_manager::asset_manager() : timeout(0), lazy_loading(false) {}
+    auto result = build(font, text, key.max_width, align);
+    entries.emplace_front(key, result);
+    lookup[key] = entries.begin();
 
-void asset_manager::cleanup() {
-    lazy_loading = false;
-    if (cleanup_thread.joinable()) {
-        cleanup_thread.join();
+    if (entries.size() > capacity) {
+        lookup.erase(entries.back().first);
+        entries.pop_back();
     }
+    return result;
 }
 
-asset_manager::~asset_manager() {
-    cleanup();
+anvil::vec2f_t text_layout_engine::measure(const anvil::font &font, const std::string &text) {
+    return layout(font, text, 0, anvil::text_align::left)->size;
 }
 
-// font
-
-font::font(std::string filepath, int font_size) {
-    FILE *f = fopen(filepath.c_str(), "rb");
-    if (!f) {
-        std::cout << util::format_error("could not open font file", -1, "fopen() - stdio.h", "error");
-        std::exit(1);
-    }
+void text_layout_engine::clear() {
+    entries.clear();
+    lookup.clear();
+}
 
-    fread(ttf_buffer, 1, 1 << 20, f);
-    fclose(f);
+uint64_t text_layout_engine::get_hits() const {
+    return hits;
+}
 
-    if (stbtt_BakeFontBitmap(ttf_buffer, 0, static_cast<float>(font_size), temp_bitmap, 512, 512, 32, 96, cdata) <= 0) {
-        std::cout << util::format_error("could not bake font bitmap", -1, "stbtt_BakeFontBitmap() - stb_truetype.h", "warning");
-    }
+uint64_t text_layout_engine::get_misses() const {
+    return misses;
+}
 
-    GLuint font_texture;
-    glGenTextures(1, &font_texture);
-    glBindTexture(GL_TEXTURE_2D, font_texture);
+// renderer_2d-extension
+void renderer_2d::draw_text(const anvil::text_layout &layout, const anvil::font &font, anvil::vec2f_t pos, anvil::rgba_color color) {
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, font.tid);
+    glColor4f((float) color.x / 255, (float) color.y / 255, (float) color.z / 255, (float) color.a / 255);
+    glBegin(GL_QUADS);
+    {
+        for (auto &g : layout.glyphs) {
+            if (g.codepoint < 32 || g.codepoint > 126) continue;
+            float x = pos.x + g.position.x;
+            float y = pos.y + g.position.y;
+            stbtt_aligned_quad q;
+            stbtt_GetBakedQuad(font.cdata, 512, 512, g.codepoint - 32, &x, &y, &q, 1);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 512, 512, 0, GL_ALPHA, GL_UNSIGNED_BYTE, temp_bitmap);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexCoord2f(q.s0, q.t0); glVertex2f(q.x0, q.y0);
+            glTexCoord2f(q.s1, q.t0); glVertex2f(q.x1, q.y0);
+            glTexCoord2f(q.s1, q.t1); glVertex2f(q.x1, q.y1);
+            glTexCoord2f(q.s0, q.t1); glVertex2f(q.x0, q.y1);
+        }
+    }
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+    triangle_count += layout.glyphs.size() * 2;
 }
 
 // renderer_2d-extension
-void renderer_2d::draw_text(std::string text, anvil::font font, anvil::vec2f_t pos, anvil::rgba_color color, float rotation) {
+void renderer_2d::draw_text(std::string text, const anvil::font &font, anvil::vec2f_t pos, anvil::rgba_color color, float rotation) {
     glLoadIdentity();
     glRotatef(rotation, 0.0, 0.0, 1.0);
 
     glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, font.tid);
     glColor4f((float) color.x / 255, (float) color.y / 255, (float) color.z / 255, (float) color.a / 255);
     glBegin(GL_QUADS);
     {
@@ -848,32 +4513,142 @@ void renderer_2d::draw_text(std::string text, anvil::font font, anvil::vec2f_t p
 }
 
 sprite::sprite(std::string filename) {
+    if (!load(filename)) {
+        std::exit(1);
+    }
+}
+
+sprite::sprite(anvil::vec2i_t size, int channels, std::vector<uint8_t> pixels)
+    : size(size), channels(channels), data(std::move(pixels)) {
+    if (data.size() != static_cast<std::size_t>(size.x) * size.y * channels) {
+        std::cout << util::format_error("pixel buffer does not match size", -1, "anvil::sprite::sprite(size, ...)", "fatal");
+        std::exit(1);
+    }
+}
+
+sprite::sprite(const anvil::archive &archive, std::string name) {
+    std::size_t length;
+    const uint8_t *bytes = archive.view(name, length);
+    std::vector<uint8_t> decompressed;
+    if (!bytes) {
+        if (!archive.read(name, decompressed)) {
+            std::cout << util::format_error("no such entry: " + name, -1, "anvil::sprite::sprite(archive, ...)", "fatal");
+            std::exit(1);
+        }
+        bytes = decompressed.data();
+        length = decompressed.size();
+    }
+    if (!load(bytes, length)) {
+        std::exit(1);
+    }
+}
+
+bool sprite::load(const uint8_t *bytes, std::size_t length) {
+    uint8_t *img = stbi_load_from_memory(bytes, static_cast<int>(length), &size.x, &size.y, &channels, 0);
+
+    if (!img) {
+        std::cout << util::format_error("could not load sprite", -1, "stbi_load_from_memory() - stb_image.h", "error");
+        return false;
+    }
+
+    data.assign(img, img + size.x * size.y * channels);
+    stbi_image_free(img);
+
+    this->path.clear();
+    return true;
+}
+
+bool sprite::load(const std::string &filename) {
     uint8_t *img = stbi_load(filename.c_str(), &size.x, &size.y, &channels, 0);
 
     if (!img) {
-        std::cout << util::format_error("could not load sprite", -1, "stbi_load() - stb_image.h", "fatal");
-        std::exit(1);
+        std::cout << util::format_error("could not load sprite", -1, "stbi_load() - stb_image.h", "error");
+        return false;
     }
 
     data.assign(img, img + size.x * size.y * channels);
     stbi_image_free(img);
+
+    this->path = filename;
+    return true;
+}
+
+bool sprite::save_to_file(std::string file, int compression_level) const {
+    if (channels != 4 && channels != 3) {
+        std::cout << util::format_error("channels=" + std::to_string(channels), -1, "anvil::sprite::save_to_file()", "error");
+        return false;
+    }
+
+    std::string extension = std::filesystem::path(file).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    std::vector<uint8_t> encoded = extension == ".qoi"
+        ? util::qoi::encode(data.data(), size, channels)
+        : util::png::encode(data.data(), size, channels, compression_level);
+
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+    if (!out) {
+        std::cout << util::format_error("could not write " + file, -1, "anvil::sprite::save_to_file()", "error");
+        return false;
+    }
+    return true;
 }
 
-void sprite::save_to_file(std::string file) const {
-    std::cout << util::format_error("not implemented", -1, "save_to_file()", "warning");
+std::future<bool> sprite::save_to_file_async(std::string file, int compression_level) const {
+    // the copy keeps the pixels alive and unchanged while the encoder runs
+    return std::async(std::launch::async, [copy = *this, file, compression_level] {
+        return copy.save_to_file(file, compression_level);
+    });
 }
 
-void sprite::resize(anvil::vec2i_t new_size) {
-    std::vector<uint8_t> new_data(new_size.x * new_size.y * channels);
+void sprite::resize(anvil::vec2i_t new_size, anvil::resize_filter filter) {
+    this->path.clear();
+    std::vector<uint8_t> new_data(static_cast<std::size_t>(new_size.x) * new_size.y * channels);
+    if (filter != anvil::resize_filter::nearest) {
+        util::resize_weights horizontal = util::make_resize_weights(filter, size.x, new_size.x);
+        util::resize_weights vertical = util::make_resize_weights(filter, size.y, new_size.y);
+        std::vector<float> intermediate(static_cast<std::size_t>(new_size.x) * size.y * channels);
+
+        util::parallel_rows(size.y, intermediate.size() * horizontal.taps, [&](int begin, int end) {
+            util::resize_rows(data.data(), size.x, intermediate.data(), new_size.x, channels, horizontal, begin, end);
+        });
+        util::parallel_rows(new_size.y, new_data.size() * vertical.taps, [&](int begin, int end) {
+            util::resize_columns(intermediate.data(), new_data.data(), new_size.x * channels, vertical, size.y, begin, end);
+        });
+
+        this->size = new_size;
+        this->data = std::move(new_data);
+        return;
+    }
+
     float xratio = static_cast<float>(size.x) / static_cast<float>(new_size.x);
     float yratio = static_cast<float>(size.y) / static_cast<float>(new_size.y);
 
+    // source byte offset of every destination column, shared by all rows
+    std::vector<std::size_t> columns(new_size.x);
+    for (int x = 0; x < new_size.x; x++) {
+        columns[x] = static_cast<std::size_t>(std::min(static_cast<int>(x * xratio), size.x - 1)) * channels;
+    }
+
+    std::size_t src_stride = static_cast<std::size_t>(size.x) * channels;
+    std::size_t dst_stride = static_cast<std::size_t>(new_size.x) * channels;
     for (int y = 0; y < new_size.y; y++) {
-        for (int x = 0; x < new_size.x; x++) {
-            int sx = static_cast<int>(x * xratio);
-            int sy = static_cast<int>(y * yratio);
-            for (int c = 0; c < channels; c++) {
-                new_data[(y * new_size.x * channels + x) * channels + c] = data[(sy * size.x + sx) * channels + c];
+        int sy = std::min(static_cast<int>(y * yratio), size.y - 1);
+        const uint8_t *src = data.data() + sy * src_stride;
+        uint8_t *dst = new_data.data() + y * dst_stride;
+
+        // rows that sample the same source row are copies of the previous one
+        if (y > 0 && std::min(static_cast<int>((y - 1) * yratio), size.y - 1) == sy) {
+            std::memcpy(dst, dst - dst_stride, dst_stride);
+            continue;
+        }
+        if (channels == 4) {
+            for (int x = 0; x < new_size.x; x++) {
+                std::memcpy(dst + x * 4, src + columns[x], 4);
+            }
+        } else {
+            for (int x = 0; x < new_size.x; x++) {
+                std::memcpy(dst + x * channels, src + columns[x], channels);
             }
         }
     }
@@ -882,47 +4657,84 @@ void sprite::resize(anvil::vec2i_t new_size) {
 }
 
 void sprite::crop(anvil::vec2i_t pos, anvil::vec2i_t size) {
-    std::vector<uint8_t> new_data(size.x * size.y * channels);
+    if (pos.x < 0 || pos.y < 0 || size.x < 0 || size.y < 0 || pos.x + size.x > this->size.x || pos.y + size.y > this->size.y) {
+        std::cout << util::format_error("crop region out of bounds", -1, "anvil::sprite::crop()", "error");
+        return;
+    }
+    this->path.clear();
+    std::vector<uint8_t> new_data(static_cast<std::size_t>(size.x) * size.y * channels);
+    std::size_t src_stride = static_cast<std::size_t>(this->size.x) * channels;
+    std::size_t dst_stride = static_cast<std::size_t>(size.x) * channels;
     for (int y = 0; y < size.y; y++) {
-        for (int x = 0; x < size.x; x++) {
-            for (int c = 0; c < channels; c++) {
-                new_data[(y * size.x + x) * channels + c] =
-                    data[((pos.y + y) * size.x + (pos.x + x)) * channels + c];
-            }
-        }
+        std::memcpy(new_data.data() + y * dst_stride,
+                    data.data() + (pos.y + y) * src_stride + static_cast<std::size_t>(pos.x) * channels,
+                    dst_stride);
     }
     this->size = size;
     this->data = std::move(new_data);
 }
 
 void sprite::fliph() {
+    this->path.clear();
+    std::size_t stride = static_cast<std::size_t>(size.x) * channels;
     for (int y = 0; y < size.y; y++) {
-        for (int x = 0; x < size.x; x++) {
-            for (int c = 0; c < channels; c++) {
-                std::swap(data[(y * size.x + x) * channels + c],
-                          data[(y * size.x + (size.x - x - 1)) * channels +c]);
+        uint8_t *row = data.data() + y * stride;
+        int left = 0;
+        int right = size.x - 1;
+#if defined(__SSE2__)
+        if (channels == 4) {
+            // swap 4 pixels from each end at once, reversing the pixel order inside the registers
+            while (right - left >= 7) {
+                uint8_t *l = row + left * 4;
+                uint8_t *r = row + (right - 3) * 4;
+                __m128i lv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(l));
+                __m128i rv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(l), _mm_shuffle_epi32(rv, _MM_SHUFFLE(0, 1, 2, 3)));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(r), _mm_shuffle_epi32(lv, _MM_SHUFFLE(0, 1, 2, 3)));
+                left += 4;
+                right -= 4;
             }
         }
+#endif
+        for (; left < right; left++, right--) {
+            std::swap_ranges(row + left * channels, row + (left + 1) * channels, row + right * channels);
+        }
     }
 }
 
 void sprite::flipv() {
-    for (int y = 0; y < size.y; y++) {
-        for (int x = 0; x < size.x; x++) {
-            for (int c = 0; c < channels; c++) {
-                std::swap(data[(y * size.x + x) * channels + c],
-                          data[((size.y - y - 1) * size.x + x) * channels + c]);
-            }
-        }
+    this->path.clear();
+    std::size_t stride = static_cast<std::size_t>(size.x) * channels;
+    for (int y = 0; y < size.y / 2; y++) {
+        uint8_t *top = data.data() + y * stride;
+        uint8_t *bottom = data.data() + (size.y - y - 1) * stride;
+        std::swap_ranges(top, top + stride, bottom);
     }
 }
 
-std::shared_ptr<texture> sprite::convert_to_texture() {
+anvil::vec2i_t sprite::get_size() const {
+    return size;
+}
+
+int sprite::get_channels() const {
+    return channels;
+}
+
+const std::vector<uint8_t> &sprite::get_data() const {
+    return data;
+}
+
+std::shared_ptr<texture> sprite::convert_to_texture(anvil::mipmap_mode mips) {
     std::shared_ptr<texture> t = std::make_shared<texture>();
     t->size = this->size;
+    t->source = this->path;
+    t->upload(data.data(), channels, mips);
+    return t;
+}
 
-    glGenTextures(1, &t->tid);
-    glBindTexture(GL_TEXTURE_2D, t->tid);
+void texture::upload(const uint8_t *pixels, int channels, anvil::mipmap_mode mips) {
+    glGenTextures(1, &tid);
+    glBindTexture(GL_TEXTURE_2D, tid);
     GLenum type;
     if (channels == 4) {
         type = GL_RGBA;
@@ -932,15 +4744,382 @@ std::shared_ptr<texture> sprite::convert_to_texture() {
         std::cout << util::format_error("channels=" + std::to_string(channels), -1, "convert_to_texture()", "fatal");
         std::exit(1);
     }
+    this->mips = mips;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x, size.y, 0,
-                 type, GL_UNSIGNED_BYTE, data.data());
+                 type, GL_UNSIGNED_BYTE, pixels);
+    gpu_bytes = static_cast<std::size_t>(size.x) * size.y * 4;
+
+    if (mips == anvil::mipmap_mode::gpu) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+        // a full chain adds a third of the base level
+        gpu_bytes += gpu_bytes / 3;
+    } else if (mips == anvil::mipmap_mode::box) {
+        std::vector<uint8_t> previous(pixels, pixels + static_cast<std::size_t>(size.x) * size.y * channels);
+        std::vector<uint8_t> next;
+        anvil::vec2i_t level_size = size;
+        int level = 0;
+        while (level_size.x > 1 || level_size.y > 1) {
+            anvil::vec2i_t next_size = { std::max(level_size.x / 2, 1), std::max(level_size.y / 2, 1) };
+            util::box_downsample(previous.data(), level_size, next, next_size, channels);
+            glTexImage2D(GL_TEXTURE_2D, ++level, GL_RGBA, next_size.x, next_size.y, 0,
+                         type, GL_UNSIGNED_BYTE, next.data());
+            gpu_bytes += static_cast<std::size_t>(next_size.x) * next_size.y * 4;
+            previous.swap(next);
+            level_size = next_size;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mips == anvil::mipmap_mode::none ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool texture::upload_compressed(const uint8_t *bytes, std::size_t length, const std::string &name) {
+    util::compressed_image image;
+    if (!util::parse_dds(bytes, length, image) && !util::parse_ktx(bytes, length, image)) {
+        std::cout << util::format_error("could not parse " + name + ", expected BC1/BC3/BC7 in dds or ktx", -1, "anvil::texture::texture()", "error");
+        return false;
+    }
+
+    size = image.size;
+    compressed = true;
+    mips = image.levels.size() > 1 ? anvil::mipmap_mode::box : anvil::mipmap_mode::none;
+    gpu_bytes = 0;
+
+    glGenTextures(1, &tid);
+    glBindTexture(GL_TEXTURE_2D, tid);
+    anvil::vec2i_t level_size = size;
+    for (std::size_t i = 0; i < image.levels.size(); i++) {
+        const auto &level = image.levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), image.format, level_size.x, level_size.y, 0,
+                               static_cast<GLsizei>(level.second), level.first);
+        gpu_bytes += level.second;
+        level_size = { std::max(level_size.x / 2, 1), std::max(level_size.y / 2, 1) };
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size() - 1));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+texture::texture(const std::string &path) {
+    std::size_t length;
+    const uint8_t *bytes = util::map_file(path, length);
+    if (!bytes) {
+        std::cout << util::format_error("could not open " + path, -1, "anvil::texture::texture()", "fatal");
+        std::exit(1);
+    }
+    bool ok = upload_compressed(bytes, length, path);
+    util::unmap_file(bytes, length);
+    if (!ok) {
+        std::exit(1);
+    }
+    source = path;
+}
+
+texture::texture(const anvil::archive &archive, const std::string &name) {
+    std::size_t length;
+    const uint8_t *bytes = archive.view(name, length);
+    std::vector<uint8_t> decompressed;
+    if (!bytes) {
+        if (!archive.read(name, decompressed)) {
+            std::cout << util::format_error("no such entry: " + name, -1, "anvil::texture::texture(archive, ...)", "fatal");
+            std::exit(1);
+        }
+        bytes = decompressed.data();
+        length = decompressed.size();
+    }
+    if (!upload_compressed(bytes, length, name)) {
+        std::exit(1);
+    }
+}
+
+texture::~texture() {
+    // textures that never got uploaded may be destroyed off the gl thread
+    if (tid) {
+        glDeleteTextures(1, &tid);
+    }
+}
+
+bool texture::is_ready() const {
+    return ready;
+}
+
+// texture uploader
+
+struct __stagingbuffer {
+    GLuint pbo;
+    std::size_t capacity;
+
+    // null while the buffer is free
+    GLsync fence;
+    std::shared_ptr<anvil::texture> target;
+};
+
+struct __pendingupload {
+    std::shared_ptr<anvil::texture> target;
+    anvil::sprite pixels;
+};
+
+texture_uploader::texture_uploader(std::size_t buffer_count, std::size_t buffer_size) {
+    buffers.resize(buffer_count);
+    for (auto &b : buffers) {
+        glGenBuffers(1, &b.pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, b.pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer_size, nullptr, GL_STREAM_DRAW);
+        b.capacity = buffer_size;
+        b.fence = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+std::shared_ptr<anvil::texture> texture_uploader::upload(anvil::sprite sprite) {
+    std::shared_ptr<anvil::texture> t = std::make_shared<anvil::texture>();
+    t->size = sprite.size;
+    t->source = sprite.path;
+    t->ready = false;
+    t->gpu_bytes = static_cast<std::size_t>(sprite.size.x) * sprite.size.y * 4;
+
+    if (sprite.channels != 4 && sprite.channels != 3) {
+        std::cout << util::format_error("channels=" + std::to_string(sprite.channels), -1, "anvil::texture_uploader::upload()", "fatal");
+        std::exit(1);
+    }
+
+    // allocate storage now so the texture id is usable right away
+    glGenTextures(1, &t->tid);
+    glBindTexture(GL_TEXTURE_2D, t->tid);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, t->size.x, t->size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glBindTexture(GL_TEXTURE_2D, 0);
 
+    queue.push_back({ t, std::move(sprite) });
+    return t;
+}
+
+void texture_uploader::update() {
+    // retire finished uploads
+    for (auto &b : buffers) {
+        if (!b.fence) {
+            continue;
+        }
+        GLenum status = glClientWaitSync(b.fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            glDeleteSync(b.fence);
+            b.fence = nullptr;
+            b.target->ready = true;
+            b.target.reset();
+        }
+    }
+
+    std::size_t started = 0;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (auto &b : buffers) {
+        if (b.fence) {
+            continue;
+        }
+
+        // uploads that fit no buffer go synchronously, they would block the queue forever otherwise
+        while (started < queue.size()) {
+            __pendingupload &p = queue[started];
+            std::size_t bytes = p.pixels.data.size();
+            if (bytes <= b.capacity) {
+                break;
+            }
+            GLenum format = p.pixels.channels == 4 ? GL_RGBA : GL_RGB;
+            glBindTexture(GL_TEXTURE_2D, p.target->tid);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, p.target->size.x, p.target->size.y, format, GL_UNSIGNED_BYTE, p.pixels.data.data());
+            p.target->ready = true;
+            started++;
+        }
+        if (started >= queue.size()) {
+            break;
+        }
+
+        __pendingupload &p = queue[started++];
+        std::size_t bytes = p.pixels.data.size();
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, b.pbo);
+        // the previous upload from this buffer has finished, so invalidating can't stall
+        void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!mapped) {
+            std::cout << util::format_error("glMapBufferRange()", glGetError(), "opengl", "error");
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            started--;
+            break;
+        }
+        std::memcpy(mapped, p.pixels.data.data(), bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        GLenum format = p.pixels.channels == 4 ? GL_RGBA : GL_RGB;
+        glBindTexture(GL_TEXTURE_2D, p.target->tid);
+        // reads from offset 0 of the bound pixel buffer
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, p.target->size.x, p.target->size.y, format, GL_UNSIGNED_BYTE, nullptr);
+        // unbind right away, the synchronous path above passes client pointers which would be read as offsets into it
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        b.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        b.target = p.target;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    queue.erase(queue.begin(), queue.begin() + started);
+}
+
+std::size_t texture_uploader::pending() const {
+    std::size_t in_flight = 0;
+    for (auto &b : buffers) {
+        if (b.fence) {
+            in_flight++;
+        }
+    }
+    return queue.size() + in_flight;
+}
+
+void texture_uploader::cleanup() {
+    for (auto &b : buffers) {
+        if (b.fence) {
+            glClientWaitSync(b.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(b.fence);
+            b.target->ready = true;
+        }
+        glDeleteBuffers(1, &b.pbo);
+    }
+    buffers.clear();
+    queue.clear();
+}
+
+texture_uploader::~texture_uploader() {
+    cleanup();
+}
+
+// texture cache
+
+texture_cache::texture_cache(std::string directory) : directory(directory) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        std::cout << util::format_error("could not create " + directory, ec.value(), "anvil::texture_cache::texture_cache()", "warning");
+    }
+}
+
+std::string texture_cache::entry_path(const std::string &source) const {
+    std::stringstream name;
+    name << std::hex << util::fnv1a64(source.data(), source.size()) << ".anviltex";
+    return (std::filesystem::path(directory) / name.str()).string();
+}
+
+bool texture_cache::contains(const std::string &source) const {
+    std::size_t mapping_size;
+    const uint8_t *mapping = util::map_cache_entry(entry_path(source), source, mapping_size);
+    if (!mapping) {
+        return false;
+    }
+    util::unmap_file(mapping, mapping_size);
+    return true;
+}
+
+std::shared_ptr<anvil::texture> texture_cache::load(const std::string &source) {
+    std::string entry = entry_path(source);
+
+    std::size_t mapping_size;
+    const uint8_t *mapping = util::map_cache_entry(entry, source, mapping_size);
+    if (mapping) {
+        const util::texture_cache_header *h = reinterpret_cast<const util::texture_cache_header *>(mapping);
+        std::shared_ptr<anvil::texture> t = std::make_shared<anvil::texture>();
+        t->size = { h->width, h->height };
+        t->source = source;
+        t->upload(mapping + h->pixels_offset, 4);
+        util::unmap_file(mapping, mapping_size);
+        hits++;
+        return t;
+    }
+    misses++;
+
+    int64_t mtime;
+    uint64_t source_size;
+    if (!util::stat_source(source, mtime, source_size)) {
+        std::cout << util::format_error("could not stat " + source, -1, "anvil::texture_cache::load()", "error");
+        return nullptr;
+    }
+
+    anvil::vec2i_t size;
+    int channels;
+    uint8_t *pixels = stbi_load(source.c_str(), &size.x, &size.y, &channels, 4);
+    if (!pixels) {
+        std::cout << util::format_error("could not load " + source, -1, "stbi_load() - stb_image.h", "error");
+        return nullptr;
+    }
+
+    util::texture_cache_header h = {};
+    std::memcpy(h.magic, "ANVILTEX", 8);
+    h.version = 1;
+    h.path_length = static_cast<uint32_t>(source.size());
+    h.width = size.x;
+    h.height = size.y;
+    h.source_mtime = mtime;
+    h.source_size = source_size;
+    h.pixels_offset = (sizeof(h) + source.size() + 15) & ~uint64_t(15);
+
+    // write to a temporary and rename so a crash never leaves a truncated entry behind
+    std::string temporary = entry + ".tmp";
+    bool written;
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        static const char padding[16] = {};
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        out.write(source.data(), source.size());
+        out.write(padding, h.pixels_offset - sizeof(h) - source.size());
+        out.write(reinterpret_cast<const char *>(pixels), static_cast<std::size_t>(size.x) * size.y * 4);
+        // closing flushes, which is where a full disk shows up
+        out.close();
+        written = static_cast<bool>(out);
+    }
+    if (!written) {
+        std::cout << util::format_error("could not write " + temporary, -1, "anvil::texture_cache::load()", "warning");
+        std::remove(temporary.c_str());
+    } else {
+        std::error_code ec;
+        std::filesystem::rename(temporary, entry, ec);
+        if (ec) {
+            std::remove(temporary.c_str());
+        }
+    }
+
+    std::shared_ptr<anvil::texture> t = std::make_shared<anvil::texture>();
+    t->size = size;
+    t->source = source;
+    t->upload(pixels, 4);
+    stbi_image_free(pixels);
     return t;
 }
 
+void texture_cache::clear() {
+    std::error_code ec;
+    for (auto &e : std::filesystem::directory_iterator(directory, ec)) {
+        if (e.path().extension() == ".anviltex") {
+            std::filesystem::remove(e.path(), ec);
+        }
+    }
+}
+
+uint64_t texture_cache::get_hits() const {
+    return hits;
+}
+
+uint64_t texture_cache::get_misses() const {
+    return misses;
+}
+
+anvil::memory_usage texture::get_memory_usage() const {
+    return { 0, gpu_bytes };
+}
+
 }
 
 namespace anvil {
@@ -958,10 +5137,106 @@ void add_listener(mouse_move_listener_t listener) {
     mouse_move_listeners.push_back(listener);
 }
 
+bool input_state::is_down(keyboard_key key) const {
+    int k = static_cast<int>(key);
+    return k >= 0 && keys[k];
+}
+
+bool input_state::was_pressed(keyboard_key key) const {
+    int k = static_cast<int>(key);
+    return k >= 0 && pressed_keys[k];
+}
+
+bool input_state::was_released(keyboard_key key) const {
+    int k = static_cast<int>(key);
+    return k >= 0 && released_keys[k];
+}
+
+bool input_state::is_down(mouse_button button) const {
+    return buttons[static_cast<int>(button)];
+}
+
+bool input_state::was_pressed(mouse_button button) const {
+    return pressed_buttons[static_cast<int>(button)];
+}
+
+bool input_state::was_released(mouse_button button) const {
+    return released_buttons[static_cast<int>(button)];
+}
+
+void set_buffered(bool enabled, std::size_t capacity, bool coalesce_mouse_moves) {
+    // queue the held back move before the ring it belongs to is retired
+    util::flush_pending_move();
+    input_coalesce_moves = coalesce_mouse_moves;
+
+    std::shared_ptr<__inputqueue> current = std::atomic_load(&input_queue);
+    if (!enabled) {
+        if (current) {
+            // retired before clearing input_queue, so a consumer always finds the chain in one of them
+            std::atomic_store(&input_retired, current);
+            std::atomic_store(&input_queue, std::shared_ptr<__inputqueue>());
+        }
+        return;
+    }
+    if (current && current->capacity == capacity) {
+        return;
+    }
+
+    std::shared_ptr<__inputqueue> queue = std::make_shared<__inputqueue>(capacity);
+    queue->previous = current ? current : std::atomic_load(&input_retired);
+    std::atomic_store(&input_queue, queue);
+    std::atomic_store(&input_retired, std::shared_ptr<__inputqueue>());
+}
+
+bool is_buffered() {
+    return std::atomic_load(&input_queue) != nullptr;
+}
+
+bool poll_event(input_event &out) {
+    return util::pop_input(util::input_chain(), out);
+}
+
+std::size_t drain_events(std::vector<input_event> &out) {
+    std::shared_ptr<__inputqueue> queue = util::input_chain();
+    std::size_t count = 0;
+    input_event event;
+    while (util::pop_input(queue, event)) {
+        out.push_back(event);
+        count++;
+    }
+    return count;
+}
+
+std::size_t get_dropped_events() {
+    return input_dropped.load(std::memory_order_relaxed);
+}
+
+const input_state &get_input_state() {
+    return input_snapshot;
+}
+
 bool is_down(keyboard_key key) {
-    return ((glfwGetKey(glfwGetCurrentContext(), static_cast<int>(key)) == GLFW_PRESS
-    || glfwGetKey(glfwGetCurrentContext(), static_cast<int>(key)) == GLFW_REPEAT)
-    || glfwGetKey(glfwGetCurrentContext(), static_cast<int>(key)) != GLFW_RELEASE);
+    return input_snapshot.is_down(key);
+}
+
+bool was_pressed(keyboard_key key) {
+    return input_snapshot.was_pressed(key);
+}
+
+bool was_released(keyboard_key key) {
+    return input_snapshot.was_released(key);
+}
+
+bool is_down(mouse_button button) {
+    return input_snapshot.is_down(button);
+}
+
+bool was_pressed(mouse_button button) {
+    return input_snapshot.was_pressed(button);
+}
+
+bool was_released(mouse_button button) {
+    return input_snapshot.was_released(button);
 }
 
 }
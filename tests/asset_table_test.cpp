@@ -0,0 +1,157 @@
+#include <runtime.hpp>
+
+#include "check.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// stress test for the table behind asset_manager: readers acquire while other threads evict, expire, remove and insert
+// build with -fsanitize=thread to check the locking as well
+
+namespace {
+
+struct counted {
+    static std::atomic<int> alive;
+    static std::atomic<int> reloads;
+
+    counted() { alive++; }
+    ~counted() { alive--; }
+
+    anvil::memory_usage get_memory_usage() const { return { 1000, 24 }; }
+};
+
+std::atomic<int> counted::alive{ 0 };
+std::atomic<int> counted::reloads{ 0 };
+
+std::shared_ptr<counted> reload(anvil::asset_handle<counted>) {
+    counted::reloads++;
+    return std::make_shared<counted>();
+}
+
+}
+
+int main() {
+    constexpr std::size_t permanent_count = 2000;
+    constexpr std::size_t churn_count = 200;
+    constexpr int reader_count = 8;
+    const auto duration = std::chrono::seconds(2);
+
+    anvil::__assettable<counted> table;
+    std::vector<anvil::asset_handle<counted>> permanent;
+    for (std::size_t i = 0; i < permanent_count; i++) {
+        permanent.push_back(table.insert(std::make_shared<counted>(), reload));
+    }
+    // removed and inserted again while the readers run, so their slots get reused with new generations
+    std::vector<anvil::asset_handle<counted>> churn;
+    for (std::size_t i = 0; i < churn_count; i++) {
+        churn.push_back(table.insert(std::make_shared<counted>(), reload));
+    }
+
+    std::atomic<bool> stop{ false };
+    std::atomic<int> missing{ 0 };
+    std::atomic<uint64_t> acquires{ 0 };
+    std::atomic<uint64_t> evictions{ 0 };
+    std::atomic<uint64_t> expiries{ 0 };
+    std::atomic<uint64_t> replacements{ 0 };
+    std::vector<std::thread> threads;
+
+    for (int r = 0; r < reader_count; r++) {
+        threads.emplace_back([&, r] {
+            std::mt19937 rng(r);
+            std::uniform_int_distribution<std::size_t> pick(0, permanent_count - 1);
+            std::uniform_int_distribution<std::size_t> pick_churn(0, churn_count - 1);
+            uint64_t count = 0;
+            while (!stop) {
+                // permanent handles must always resolve, evicted or not
+                if (!table.acquire(permanent[pick(rng)])) {
+                    missing++;
+                }
+                // churn handles may be stale by now, only the lookup itself has to be safe
+                table.acquire(churn[pick_churn(rng)]);
+                // real readers work between lookups, without any gaps the reader-preferring shared_mutex starves the writers
+                if (++count % 256 == 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+            acquires += count;
+        });
+    }
+
+    threads.emplace_back([&] {
+        while (!stop) {
+            std::vector<anvil::__evictcandidate> candidates;
+            table.collect_evictable(anvil::asset_type::texture, candidates);
+            for (std::size_t i = 0; i < candidates.size(); i += 3) {
+                if (table.evict(candidates[i].index, candidates[i].generation)) {
+                    evictions++;
+                }
+            }
+        }
+    });
+
+    threads.emplace_back([&] {
+        std::mt19937 rng(100);
+        std::uniform_int_distribution<std::size_t> pick(0, permanent_count - 1);
+        while (!stop) {
+            const auto &h = permanent[pick(rng)];
+            anvil::__assetslot<counted>::clock::time_point last_access;
+            table.expire(h.index, h.generation, anvil::__assetslot<counted>::clock::now(), last_access);
+            expiries++;
+        }
+    });
+
+    // readers keep using the original churn handles, which go stale as they are replaced here
+    std::vector<anvil::asset_handle<counted>> churn_owned = churn;
+    threads.emplace_back([&] {
+        std::mt19937 rng(200);
+        std::uniform_int_distribution<std::size_t> pick(0, churn_count - 1);
+        while (!stop) {
+            std::size_t i = pick(rng);
+            check(table.remove(churn_owned[i]), "removing a live handle");
+            check(!table.acquire(churn_owned[i]), "acquiring a removed handle");
+            churn_owned[i] = table.insert(std::make_shared<counted>(), reload);
+            replacements++;
+        }
+    });
+
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    check(evictions > 0 && expiries > 0 && replacements > 0 && counted::reloads > 0, "every thread made progress");
+    check(missing == 0, "permanent handles resolved (" + std::to_string(missing.load()) + " missing)");
+
+    // the byte totals must match what is actually loaded, and nothing may be leaked or double freed
+    std::size_t loaded = 0;
+    for (const auto &slot : table.slots) {
+        if (slot.asset) {
+            loaded++;
+        }
+    }
+    anvil::memory_usage usage = table.get_memory_usage();
+    check(usage.cpu_bytes == loaded * 1000 && usage.gpu_bytes == loaded * 24,
+          "memory accounting (" + std::to_string(usage.cpu_bytes) + " bytes for " + std::to_string(loaded) + " loaded assets)");
+    check(counted::alive == static_cast<int>(loaded), "live assets match loaded slots");
+
+    for (const auto &h : permanent) {
+        check(table.remove(h), "removing a permanent handle");
+    }
+    for (const auto &h : churn_owned) {
+        check(table.remove(h), "removing a churn handle");
+    }
+    check(counted::alive == 0, "every asset destroyed after removal");
+    check(table.get_memory_usage().total() == 0, "no bytes counted after removal");
+
+    std::cout << acquires.load() << " acquires, " << counted::reloads.load() << " reloads, "
+              << evictions.load() << " evictions, " << expiries.load() << " expiries, " << replacements.load() << " replacements\n";
+    return report();
+}
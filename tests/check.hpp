@@ -0,0 +1,31 @@
+#ifndef ANVIL_GAMEENGINE_TESTS_CHECK_HPP_INCLUDE_HEADER
+#define ANVIL_GAMEENGINE_TESTS_CHECK_HPP_INCLUDE_HEADER
+
+#include <atomic>
+#include <iostream>
+#include <string>
+
+// shared by the tests, each test is a single translation unit
+
+// atomic so checks can run on worker threads
+inline std::atomic<int> failures{ 0 };
+
+/// @brief print and count a failed check, the test keeps going
+inline void check(bool condition, const std::string &what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << '\n';
+        failures++;
+    }
+}
+
+/// @brief print the outcome, returns the exit code for main
+inline int report() {
+    if (failures) {
+        std::cout << failures.load() << " checks failed\n";
+        return 1;
+    }
+    std::cout << "all checks passed\n";
+    return 0;
+}
+
+#endif
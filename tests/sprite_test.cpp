@@ -0,0 +1,342 @@
+#include <runtime.hpp>
+
+#include "check.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// sprite flips, crop and resize against scalar references, and png/qoi encode round-trips
+// no gl context needed
+
+namespace {
+
+std::string describe(anvil::vec2i_t size, int channels) {
+    return std::to_string(size.x) + "x" + std::to_string(size.y) + "x" + std::to_string(channels);
+}
+
+std::vector<uint8_t> make_pixels(anvil::vec2i_t size, int channels, uint32_t seed) {
+    std::vector<uint8_t> pixels(static_cast<std::size_t>(size.x) * size.y * channels);
+    uint32_t state = seed * 2654435761u + 1;
+    for (auto &p : pixels) {
+        state = state * 1664525u + 1013904223u;
+        p = static_cast<uint8_t>(state >> 24);
+    }
+    return pixels;
+}
+
+uint8_t at(const std::vector<uint8_t> &pixels, anvil::vec2i_t size, int channels, int x, int y, int c) {
+    return pixels[(static_cast<std::size_t>(y) * size.x + x) * channels + c];
+}
+
+bool same(const anvil::sprite &s, anvil::vec2i_t size, int channels, const std::vector<uint8_t> &expected) {
+    return s.get_size().x == size.x && s.get_size().y == size.y && s.get_channels() == channels && s.get_data() == expected;
+}
+
+// sizes around the 4 pixel sse2 step of fliph, odd and even
+const anvil::vec2i_t sizes[] = { { 1, 1 }, { 2, 3 }, { 7, 4 }, { 8, 5 }, { 9, 8 }, { 16, 1 }, { 33, 17 } };
+
+void test_flips(int channels) {
+    for (anvil::vec2i_t size : sizes) {
+        std::vector<uint8_t> source = make_pixels(size, channels, size.x * 31 + size.y);
+
+        std::vector<uint8_t> expected(source.size());
+        for (int y = 0; y < size.y; y++) {
+            for (int x = 0; x < size.x; x++) {
+                for (int c = 0; c < channels; c++) {
+                    expected[(static_cast<std::size_t>(y) * size.x + x) * channels + c] = at(source, size, channels, size.x - 1 - x, y, c);
+                }
+            }
+        }
+        anvil::sprite h(size, channels, source);
+        h.fliph();
+        check(same(h, size, channels, expected), "fliph " + describe(size, channels));
+        h.fliph();
+        check(same(h, size, channels, source), "fliph twice " + describe(size, channels));
+
+        for (int y = 0; y < size.y; y++) {
+            for (int x = 0; x < size.x; x++) {
+                for (int c = 0; c < channels; c++) {
+                    expected[(static_cast<std::size_t>(y) * size.x + x) * channels + c] = at(source, size, channels, x, size.y - 1 - y, c);
+                }
+            }
+        }
+        anvil::sprite v(size, channels, source);
+        v.flipv();
+        check(same(v, size, channels, expected), "flipv " + describe(size, channels));
+    }
+}
+
+void test_crop(int channels) {
+    anvil::vec2i_t size = { 23, 19 };
+    std::vector<uint8_t> source = make_pixels(size, channels, 7);
+    struct region {
+        anvil::vec2i_t pos;
+        anvil::vec2i_t size;
+    };
+    const region regions[] = { { { 0, 0 }, { 23, 19 } }, { { 0, 0 }, { 1, 1 } }, { { 5, 3 }, { 11, 9 } }, { { 22, 18 }, { 1, 1 } }, { { 4, 0 }, { 19, 19 } } };
+    for (const region &r : regions) {
+        std::vector<uint8_t> expected;
+        for (int y = 0; y < r.size.y; y++) {
+            for (int x = 0; x < r.size.x; x++) {
+                for (int c = 0; c < channels; c++) {
+                    expected.push_back(at(source, size, channels, r.pos.x + x, r.pos.y + y, c));
+                }
+            }
+        }
+        anvil::sprite s(size, channels, source);
+        s.crop(r.pos, r.size);
+        check(same(s, r.size, channels, expected), "crop " + describe(r.size, channels) + " at " + std::to_string(r.pos.x) + "," + std::to_string(r.pos.y));
+    }
+
+    // regions outside the sprite are rejected and leave it untouched
+    anvil::sprite s(size, channels, source);
+    s.crop({ 20, 0 }, { 4, 4 });
+    s.crop({ -1, 0 }, { 4, 4 });
+    check(same(s, size, channels, source), "out of bounds crop is a no-op " + describe(size, channels));
+}
+
+// same conventions as the library: pixel centers at +0.5, kernel widened by the scale when downscaling,
+// taps outside the source dropped and the rest renormalized, computed in doubles
+double kernel(anvil::resize_filter filter, double x) {
+    const double pi = 3.14159265358979323846;
+    x = std::fabs(x);
+    switch (filter) {
+        case anvil::resize_filter::bilinear:
+            return x < 1.0 ? 1.0 - x : 0.0;
+        case anvil::resize_filter::bicubic:
+            if (x < 1.0) {
+                return 1.5 * x * x * x - 2.5 * x * x + 1.0;
+            } else if (x < 2.0) {
+                return -0.5 * x * x * x + 2.5 * x * x - 4.0 * x + 2.0;
+            }
+            return 0.0;
+        case anvil::resize_filter::lanczos:
+            if (x < 1e-5) {
+                return 1.0;
+            } else if (x >= 3.0) {
+                return 0.0;
+            }
+            return 3.0 * std::sin(pi * x) * std::sin(pi * x / 3.0) / (pi * pi * x * x);
+        default:
+            return 0.0;
+    }
+}
+
+std::vector<std::vector<double>> axis_weights(anvil::resize_filter filter, int src, int dst) {
+    double scale = static_cast<double>(src) / dst;
+    double stretch = std::max(scale, 1.0);
+    std::vector<std::vector<double>> weights(dst, std::vector<double>(src, 0.0));
+    for (int i = 0; i < dst; i++) {
+        double center = (i + 0.5) * scale - 0.5;
+        double total = 0.0;
+        for (int j = 0; j < src; j++) {
+            weights[i][j] = kernel(filter, (j - center) / stretch);
+            total += weights[i][j];
+        }
+        for (double &w : weights[i]) {
+            w /= total;
+        }
+    }
+    return weights;
+}
+
+std::vector<uint8_t> reference_resize(const std::vector<uint8_t> &source, anvil::vec2i_t size, int channels, anvil::vec2i_t new_size, anvil::resize_filter filter) {
+    std::vector<uint8_t> out(static_cast<std::size_t>(new_size.x) * new_size.y * channels);
+    if (filter == anvil::resize_filter::nearest) {
+        float xratio = static_cast<float>(size.x) / static_cast<float>(new_size.x);
+        float yratio = static_cast<float>(size.y) / static_cast<float>(new_size.y);
+        for (int y = 0; y < new_size.y; y++) {
+            int sy = std::min(static_cast<int>(y * yratio), size.y - 1);
+            for (int x = 0; x < new_size.x; x++) {
+                int sx = std::min(static_cast<int>(x * xratio), size.x - 1);
+                for (int c = 0; c < channels; c++) {
+                    out[(static_cast<std::size_t>(y) * new_size.x + x) * channels + c] = at(source, size, channels, sx, sy, c);
+                }
+            }
+        }
+        return out;
+    }
+
+    std::vector<std::vector<double>> horizontal = axis_weights(filter, size.x, new_size.x);
+    std::vector<std::vector<double>> vertical = axis_weights(filter, size.y, new_size.y);
+    std::vector<double> rows(static_cast<std::size_t>(new_size.x) * size.y * channels, 0.0);
+    for (int y = 0; y < size.y; y++) {
+        for (int x = 0; x < new_size.x; x++) {
+            for (int c = 0; c < channels; c++) {
+                double acc = 0.0;
+                for (int j = 0; j < size.x; j++) {
+                    acc += horizontal[x][j] * at(source, size, channels, j, y, c);
+                }
+                rows[(static_cast<std::size_t>(y) * new_size.x + x) * channels + c] = acc;
+            }
+        }
+    }
+    std::size_t row_length = static_cast<std::size_t>(new_size.x) * channels;
+    for (int y = 0; y < new_size.y; y++) {
+        for (std::size_t i = 0; i < row_length; i++) {
+            double acc = 0.0;
+            for (int j = 0; j < size.y; j++) {
+                acc += vertical[y][j] * rows[j * row_length + i];
+            }
+            out[y * row_length + i] = static_cast<uint8_t>(std::min(255.0, std::max(0.0, std::round(acc))));
+        }
+    }
+    return out;
+}
+
+const anvil::resize_filter filters[] = { anvil::resize_filter::nearest, anvil::resize_filter::bilinear, anvil::resize_filter::bicubic, anvil::resize_filter::lanczos };
+const char *filter_names[] = { "nearest", "bilinear", "bicubic", "lanczos" };
+
+void test_resize(int channels) {
+    anvil::vec2i_t size = { 37, 23 };
+    std::vector<uint8_t> source = make_pixels(size, channels, 3);
+    const anvil::vec2i_t targets[] = { { 37, 23 }, { 64, 50 }, { 13, 9 }, { 1, 1 }, { 74, 11 }, { 5, 46 } };
+
+    for (int f = 0; f < 4; f++) {
+        for (anvil::vec2i_t target : targets) {
+            std::string name = std::string(filter_names[f]) + " resize " + describe(size, channels) + " to " + describe(target, channels);
+            anvil::sprite s(size, channels, source);
+            s.resize(target, filters[f]);
+            if (s.get_size().x != target.x || s.get_size().y != target.y || s.get_channels() != channels) {
+                check(false, name + " size");
+                continue;
+            }
+
+            // the library accumulates in floats, allow one step of rounding
+            std::vector<uint8_t> expected = reference_resize(source, size, channels, target, filters[f]);
+            int worst = 0;
+            for (std::size_t i = 0; i < expected.size(); i++) {
+                worst = std::max(worst, std::abs(static_cast<int>(s.get_data()[i]) - static_cast<int>(expected[i])));
+            }
+            check(worst <= (filters[f] == anvil::resize_filter::nearest ? 0 : 1), name + " differs by " + std::to_string(worst));
+
+            // a flat image stays flat whatever the filter, lobes and edge renormalization included
+            anvil::sprite flat(size, channels, std::vector<uint8_t>(source.size(), 200));
+            flat.resize(target, filters[f]);
+            check(std::all_of(flat.get_data().begin(), flat.get_data().end(), [](uint8_t p) { return p == 200; }), name + " of a flat image");
+        }
+    }
+}
+
+// independent decoder for the qoi specification, the library only encodes
+bool decode_qoi(const std::vector<uint8_t> &bytes, anvil::vec2i_t &size, int &channels, std::vector<uint8_t> &pixels) {
+    if (bytes.size() < 22 || std::string(bytes.begin(), bytes.begin() + 4) != "qoif") {
+        return false;
+    }
+    auto be32 = [&](std::size_t i) {
+        return static_cast<int>((uint32_t(bytes[i]) << 24) | (uint32_t(bytes[i + 1]) << 16) | (uint32_t(bytes[i + 2]) << 8) | bytes[i + 3]);
+    };
+    size = { be32(4), be32(8) };
+    channels = bytes[12];
+    if (channels != 3 && channels != 4) {
+        return false;
+    }
+
+    uint8_t index[64][4] = {};
+    uint8_t px[4] = { 0, 0, 0, 255 };
+    std::size_t count = static_cast<std::size_t>(size.x) * size.y;
+    std::size_t end = bytes.size() - 8;
+    std::size_t p = 14;
+    pixels.clear();
+    int run = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        if (run > 0) {
+            run--;
+        } else if (p < end) {
+            uint8_t b = bytes[p++];
+            if (b == 0xfe) {
+                px[0] = bytes[p++];
+                px[1] = bytes[p++];
+                px[2] = bytes[p++];
+            } else if (b == 0xff) {
+                px[0] = bytes[p++];
+                px[1] = bytes[p++];
+                px[2] = bytes[p++];
+                px[3] = bytes[p++];
+            } else if ((b & 0xc0) == 0x00) {
+                std::copy(index[b], index[b] + 4, px);
+            } else if ((b & 0xc0) == 0x40) {
+                px[0] += ((b >> 4) & 3) - 2;
+                px[1] += ((b >> 2) & 3) - 2;
+                px[2] += (b & 3) - 2;
+            } else if ((b & 0xc0) == 0x80) {
+                int dg = (b & 0x3f) - 32;
+                uint8_t next = bytes[p++];
+                px[0] += dg - 8 + ((next >> 4) & 0x0f);
+                px[1] += dg;
+                px[2] += dg - 8 + (next & 0x0f);
+            } else {
+                run = b & 0x3f;
+            }
+            std::copy(px, px + 4, index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64]);
+        } else {
+            return false;
+        }
+        pixels.insert(pixels.end(), px, px + channels);
+    }
+    static const uint8_t padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    return p == end && std::equal(padding, padding + 8, bytes.begin() + end);
+}
+
+void test_round_trips(const std::filesystem::path &directory, int channels) {
+    // noise, flat runs and slow gradients hit the literal, run, index and diff paths of both encoders
+    anvil::vec2i_t size = { 61, 40 };
+    std::vector<uint8_t> source = make_pixels(size, channels, 11);
+    for (int y = 10; y < 20; y++) {
+        for (int x = 0; x < size.x; x++) {
+            for (int c = 0; c < channels; c++) {
+                source[(static_cast<std::size_t>(y) * size.x + x) * channels + c] = static_cast<uint8_t>(y < 15 ? 90 : x * 2 + c);
+            }
+        }
+    }
+    for (int y = 20; y < 24; y++) {
+        for (int x = 0; x < size.x; x++) {
+            std::copy_n(&source[(static_cast<std::size_t>(20) * size.x + x % 3) * channels], channels, &source[(static_cast<std::size_t>(y) * size.x + x) * channels]);
+        }
+    }
+    anvil::sprite s(size, channels, source);
+
+    for (int level : { 0, 1, 6, 9 }) {
+        std::string path = (directory / ("round_trip" + std::to_string(channels) + "_" + std::to_string(level) + ".png")).string();
+        check(s.save_to_file(path, level), "png save " + describe(size, channels) + " level " + std::to_string(level));
+        anvil::sprite loaded(path);
+        check(same(loaded, size, channels, source), "png round trip " + describe(size, channels) + " level " + std::to_string(level));
+    }
+
+    std::string path = (directory / ("round_trip" + std::to_string(channels) + ".qoi")).string();
+    check(s.save_to_file(path), "qoi save " + describe(size, channels));
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    anvil::vec2i_t decoded_size;
+    int decoded_channels = 0;
+    std::vector<uint8_t> decoded;
+    check(decode_qoi(bytes, decoded_size, decoded_channels, decoded), "qoi decodes " + describe(size, channels));
+    check(decoded_size.x == size.x && decoded_size.y == size.y && decoded_channels == channels && decoded == source, "qoi round trip " + describe(size, channels));
+}
+
+}
+
+int main() {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "anvil_sprite_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    for (int channels : { 3, 4 }) {
+        test_flips(channels);
+        test_crop(channels);
+        test_resize(channels);
+        test_round_trips(directory, channels);
+    }
+
+    std::filesystem::remove_all(directory);
+
+    return report();
+}
@@ -0,0 +1,138 @@
+#include <runtime.hpp>
+
+#include "check.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// hit, miss, invalidation and corruption paths of texture_cache
+// skipped without a display, uploads need a gl context
+
+namespace {
+
+// a hidden window, only for its gl context
+bool make_context() {
+    if (!glfwInit()) {
+        return false;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "texture_cache_test", nullptr, nullptr);
+    if (!window) {
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+    return true;
+}
+
+// uncompressed 32 bit tga with a top-left origin, stb_image decodes it like any other source
+void write_source(const std::string &path, anvil::vec2i_t size, uint8_t seed) {
+    std::vector<uint8_t> bytes(18 + static_cast<std::size_t>(size.x) * size.y * 4);
+    bytes[2] = 2;
+    bytes[12] = static_cast<uint8_t>(size.x);
+    bytes[13] = static_cast<uint8_t>(size.x >> 8);
+    bytes[14] = static_cast<uint8_t>(size.y);
+    bytes[15] = static_cast<uint8_t>(size.y >> 8);
+    bytes[16] = 32;
+    bytes[17] = 0x28;
+    for (std::size_t i = 18; i < bytes.size(); i++) {
+        bytes[i] = static_cast<uint8_t>(i * 7 + seed);
+    }
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+std::vector<std::filesystem::path> files_with_extension(const std::filesystem::path &directory, const std::string &extension) {
+    std::vector<std::filesystem::path> found;
+    for (auto &e : std::filesystem::directory_iterator(directory)) {
+        if (e.path().extension() == extension) {
+            found.push_back(e.path());
+        }
+    }
+    return found;
+}
+
+}
+
+int main() {
+    if (!make_context()) {
+        std::cout << "no gl context, skipping\n";
+        return 77;
+    }
+
+    std::filesystem::path root = std::filesystem::temp_directory_path() / "anvil_texture_cache_test";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    std::filesystem::path directory = root / "cache";
+    std::string source = (root / "source.tga").string();
+    write_source(source, { 32, 16 }, 0);
+
+    anvil::texture_cache cache(directory.string());
+
+    // first load decodes and writes an entry
+    check(!cache.contains(source), "no entry before the first load");
+    std::shared_ptr<anvil::texture> t = cache.load(source);
+    check(t != nullptr, "cold load");
+    check(cache.get_misses() == 1 && cache.get_hits() == 0, "cold load counts as a miss");
+    check(cache.contains(source), "entry written by the cold load");
+    std::vector<std::filesystem::path> entries = files_with_extension(directory, ".anviltex");
+    check(entries.size() == 1, "one entry on disk");
+    if (entries.size() != 1) {
+        return 1;
+    }
+    std::filesystem::path entry = entries[0];
+
+    // second load is served from the mapping
+    t = cache.load(source);
+    check(t && t->get_memory_usage().gpu_bytes == 32 * 16 * 4, "warm load has the source's size");
+    check(cache.get_hits() == 1, "warm load counts as a hit");
+
+    // a truncated entry is a miss and gets rewritten
+    std::filesystem::resize_file(entry, std::filesystem::file_size(entry) / 2);
+    check(!cache.contains(source), "truncated entry is rejected");
+    t = cache.load(source);
+    check(t && t->get_memory_usage().gpu_bytes == 32 * 16 * 4, "load after truncation");
+    check(cache.get_misses() == 2, "truncated entry counts as a miss");
+    check(cache.contains(source), "truncated entry rewritten");
+
+    // so is one with a broken header
+    {
+        std::fstream f(entry, std::ios::binary | std::ios::in | std::ios::out);
+        f.write("GARBAGE!", 8);
+    }
+    check(!cache.contains(source), "entry with a bad magic is rejected");
+    t = cache.load(source);
+    check(t != nullptr && cache.get_misses() == 3 && cache.contains(source), "bad magic rewritten");
+
+    // changing the source invalidates the entry
+    write_source(source, { 8, 8 }, 1);
+    check(!cache.contains(source), "entry is stale after the source changed");
+    t = cache.load(source);
+    check(t && t->get_memory_usage().gpu_bytes == 8 * 8 * 4, "load after the source changed has the new size");
+    check(cache.get_misses() == 4, "changed source counts as a miss");
+
+    // a failed write must not install anything, the temporary being a directory makes opening it fail
+    cache.clear();
+    check(!cache.contains(source), "clear removes entries");
+    std::filesystem::create_directory(entry.string() + ".tmp");
+    t = cache.load(source);
+    check(t != nullptr, "load still succeeds when the entry can't be written");
+    check(!std::filesystem::exists(entry), "failed write leaves no entry");
+    check(!std::filesystem::exists(entry.string() + ".tmp"), "failed write cleans up its temporary");
+
+    // missing sources fail without an entry
+    std::string missing = (root / "missing.tga").string();
+    check(cache.load(missing) == nullptr, "missing source returns nullptr");
+    check(!cache.contains(missing), "missing source has no entry");
+
+    check(files_with_extension(directory, ".tmp").empty(), "no temporaries left behind");
+
+    t.reset();
+    std::filesystem::remove_all(root);
+    glfwTerminate();
+
+    return report();
+}
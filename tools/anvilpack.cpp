@@ -0,0 +1,52 @@
+#include <runtime.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// anvilpack [-c] <output> <file or directory>...
+// directories are packed recursively, entries are named by their path relative to the directory
+int main(int argc, char **argv) {
+    bool compress = false;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-c") {
+            compress = true;
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() < 2) {
+        std::cout << "usage: anvilpack [-c] <output> <file or directory>...\n";
+        std::cout << "  -c  lz4-compress entries that get smaller\n";
+        return 1;
+    }
+
+    std::vector<std::pair<std::string, std::string>> files;
+    for (std::size_t i = 1; i < args.size(); i++) {
+        std::filesystem::path input(args[i]);
+        if (std::filesystem::is_directory(input)) {
+            for (auto &e : std::filesystem::recursive_directory_iterator(input)) {
+                if (e.is_regular_file()) {
+                    files.push_back({ std::filesystem::relative(e.path(), input).generic_string(), e.path().string() });
+                }
+            }
+        } else {
+            files.push_back({ input.filename().generic_string(), input.string() });
+        }
+    }
+
+    // stable output for the same inputs
+    std::sort(files.begin(), files.end());
+
+    if (!anvil::archive::pack(files, args[0], compress)) {
+        return 1;
+    }
+    std::cout << "packed " << files.size() << " files into " << args[0] << '\n';
+    return 0;
+}